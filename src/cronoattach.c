@@ -0,0 +1,350 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoattach -- descriptor passing between cronolog-attach and cronolog
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * cronolog-attach, run by Apache in place of cronolog, hands the pipe
+ * it was given as its standard input to a cronolog running as a daemon
+ * ("cronolog -D path"), so that one cronolog serves all the piped
+ * logs of a server.
+ *
+ * cronolog-attach connects to the daemon's Unix domain socket (of type
+ * SOCK_SEQPACKET, so that a request is received whole) and sends a
+ * single message: ATTACH_MAGIC and its arguments (the templates and
+ * output options, as they would be given to cronolog), each ended by
+ * a NUL, with the pipe as SCM_RIGHTS ancillary data.  The daemon
+ * replies with one byte, 'y' if it has taken over the pipe and 'n' if
+ * it refused the arguments, and closes the connection once it has read
+ * the pipe to the end (which cronolog-attach only waits for with
+ * --wait; the daemon does not need the connection to stay open).
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_SYS_UN_H
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define ATTACH_MAGIC	"cronolog-attach 1"
+
+
+/* Create a non-blocking Unix domain socket of the given type bound to
+ * path, removing any socket left there by an earlier process, and
+ * listen on it unless it is a datagram socket.
+ *
+ * Returns the socket, or -1 on error (with errno set).
+ */
+int
+socket_listen(const char *path, int type)
+{
+    struct sockaddr_un	addr;
+    struct stat		stat_buf;
+    int			fd;
+    int			err;
+
+    if (strlen(path) >= sizeof (addr.sun_path))
+    {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((lstat(path, &stat_buf) == 0) && S_ISSOCK(stat_buf.st_mode))
+    {
+	unlink(path);
+    }
+    if ((fd = socket(AF_UNIX, type, 0)) < 0)
+    {
+	return -1;
+    }
+    if (   (bind(fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+	|| ((type != SOCK_DGRAM) && (listen(fd, SOMAXCONN) < 0))
+	|| (fcntl(fd, F_SETFL, O_NONBLOCK) < 0))
+    {
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+    }
+    return fd;
+}
+
+/* Hand the descriptor fd to the daemon listening on path, with the
+ * arguments argv[0] to argv[argc - 1].
+ *
+ * Returns the connection to the daemon once it has taken over the
+ * descriptor, or -1 on error (with errno set: ENOENT or ECONNREFUSED
+ * if no daemon is listening, EINVAL if it refused the arguments).
+ */
+int
+attach_send(const char *path, int fd, int argc, char **argv)
+{
+    struct sockaddr_un	addr;
+    struct msghdr	msg;
+    struct iovec	iov;
+    struct cmsghdr	*cmsg;
+    char		control[CMSG_SPACE(sizeof (int))];
+    char		buf[ATTACH_MAX];
+    size_t		len;
+    size_t		n;
+    ssize_t		got;
+    char		reply;
+    int			conn;
+    int			err;
+    int			i;
+
+    /* The request: the magic string and the arguments */
+
+    len = sizeof (ATTACH_MAGIC);
+    memcpy(buf, ATTACH_MAGIC, len);
+    for (i = 0; i < argc; i++)
+    {
+	n = strlen(argv[i]) + 1;
+	if (len + n > sizeof (buf))
+	{
+	    errno = E2BIG;
+	    return -1;
+	}
+	memcpy(buf + len, argv[i], n);
+	len += n;
+    }
+
+    if (strlen(path) >= sizeof (addr.sun_path))
+    {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((conn = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0)
+    {
+	return -1;
+    }
+    if (connect(conn, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+    {
+	goto fail;
+    }
+
+    memset(&msg, 0, sizeof (msg));
+    iov.iov_base       = buf;
+    iov.iov_len        = len;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof (control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof (int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof (int));
+    if (sendmsg(conn, &msg, 0) < 0)
+    {
+	goto fail;
+    }
+    while (((got = read(conn, &reply, 1)) < 0) && (errno == EINTR))
+    {
+    }
+    if (got != 1)
+    {
+	errno = (got == 0) ? ECONNRESET : errno;
+	goto fail;
+    }
+    if (reply != 'y')
+    {
+	errno = EINVAL;
+	goto fail;
+    }
+    return conn;
+
+ fail:
+    err = errno;
+    close(conn);
+    errno = err;
+    return -1;
+}
+
+/* Receive the request of a cronolog-attach process on the connection
+ * conn: the descriptor it passes is put in *pfd and its arguments in
+ * a NULL-terminated vector (allocated with its strings in a single
+ * block, to be freed by the caller), whose first element is the name
+ * of the program.
+ *
+ * Returns the number of arguments (including the name), or -1 on
+ * error (with errno set: EAGAIN if the request has not arrived yet,
+ * EINVAL if it is not a request).
+ */
+int
+attach_receive(int conn, int *pfd, char ***pargv)
+{
+    struct msghdr	msg;
+    struct iovec	iov;
+    struct cmsghdr	*cmsg;
+    char		control[CMSG_SPACE(sizeof (int))];
+    char		buf[ATTACH_MAX];
+    char		**argv;
+    char		*p;
+    ssize_t		len;
+    int			argc;
+    int			fd = -1;
+    int			i;
+
+    memset(&msg, 0, sizeof (msg));
+    iov.iov_base       = buf;
+    iov.iov_len        = sizeof (buf);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof (control);
+    if ((len = recvmsg(conn, &msg, MSG_DONTWAIT)) < 0)
+    {
+	return -1;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+	if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+	{
+	    memcpy(&fd, CMSG_DATA(cmsg), sizeof (int));
+	}
+    }
+    if (   (fd < 0) || (msg.msg_flags & (MSG_TRUNC|MSG_CTRUNC))
+	|| (len < (ssize_t)sizeof (ATTACH_MAGIC)) || (buf[len - 1] != '\0')
+	|| (memcmp(buf, ATTACH_MAGIC, sizeof (ATTACH_MAGIC)) != 0))
+    {
+	if (fd >= 0)
+	{
+	    close(fd);
+	}
+	errno = EINVAL;
+	return -1;
+    }
+
+    /* Split the strings into the vector, the magic string giving way
+     * to the name of the program.
+     */
+    for (argc = 0, p = buf; p < buf + len; p += strlen(p) + 1)
+    {
+	argc++;
+    }
+    if ((argv = malloc((argc + 1) * sizeof (char *) + len)) == NULL)
+    {
+	close(fd);
+	return -1;
+    }
+    p = (char *)(argv + argc + 1);
+    memcpy(p, buf, len);
+    for (i = 0; i < argc; i++, p += strlen(p) + 1)
+    {
+	argv[i] = p;
+    }
+    argv[argc] = NULL;
+    argv[0]    = "cronolog-attach";
+    *pfd   = fd;
+    *pargv = argv;
+    return argc;
+}
+
+/* Tell a cronolog-attach process whether its pipe was taken over.
+ */
+void
+attach_reply(int conn, int accepted)
+{
+    if (write(conn, accepted ? "y" : "n", 1) < 0)
+    {
+	DEBUG(("Cannot reply to cronolog-attach: %s\n", strerror(errno)));
+    }
+}
+
+#else /* !HAVE_SYS_UN_H */
+
+int
+socket_listen(const char *path, int type)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+attach_send(const char *path, int fd, int argc, char **argv)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+attach_receive(int conn, int *pfd, char ***pargv)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+void
+attach_reply(int conn, int accepted)
+{
+}
+
+#endif
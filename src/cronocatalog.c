@@ -0,0 +1,241 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronocatalog -- catalog of closed log files for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * Each time cronolog closes a log file it can append a record to a
+ * catalog file for the template, so that retention, query, backup and
+ * ingestion tools can find the log files without searching directory
+ * trees.  Each record is a line of tab-separated fields:
+ *
+ *	PATH PERIOD-START PERIOD-END OFFSET BYTES LINES FIRST LAST CRC32C
+ *
+ * where the times are in seconds since the epoch, OFFSET and BYTES
+ * give the range of the file written by this process (a file that is
+ * appended to after a restart has a record for each part), LINES is
+ * the number of lines of log data in that range, FIRST and LAST are
+ * the times of the first and last writes and CRC32C is the checksum
+ * of the bytes written, in hexadecimal.
+ *
+ * Records are appended with a single write() each, so several
+ * cronolog processes may share a catalog.
+ *
+ * Alternatively (or as well) the checksum of each whole log file can
+ * be kept in a sidecar file, named after the log file with SUM_SUFFIX
+ * appended, holding the CRC-32C and the length of the file that it
+ * covers.  If a log file is appended to after a restart its checksum
+ * is carried on from that in the sidecar.
+ */
+
+#include "cronoutils.h"
+
+
+/* Open the catalog file of an output.
+ */
+int
+catalog_open(LOG_OUTPUT *output)
+{
+    output->catalog_fd = open(output->catalog, O_WRONLY|O_CREAT|O_APPEND, FILE_MODE);
+    if (output->catalog_fd < 0)
+    {
+	perror(output->catalog);
+    }
+    return output->catalog_fd;
+}
+
+/* Construct the name of the checksum sidecar of a log file.  Returns
+ * -1 (with errno set to ENAMETOOLONG) if the name does not fit.
+ */
+int
+checksum_filename(const char *filename, char *psumname, size_t psumname_len)
+{
+    if ((size_t)snprintf(psumname, psumname_len, "%s%s", filename, SUM_SUFFIX) >= psumname_len)
+    {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    return 0;
+}
+
+/* Set up the checksum sidecar for a newly opened log file.  If the
+ * file already has data the checksum of that data is taken from the
+ * existing sidecar if that covers exactly the data in the file, and
+ * otherwise calculated by reading the file.
+ */
+void
+checksum_open(LOG_OUTPUT *output)
+{
+    char		sumname[MAX_PATH];
+    char		buf[BUFSIZE];
+    FILE		*fp;
+    unsigned long	crc;
+    long		length;
+    off_t		remaining;
+    int			fd;
+    int			n;
+
+    output->base_checksum = 0;
+    if (!output->write_sum || (output->writer.start_length == 0))
+    {
+	return;
+    }
+    if (checksum_filename(output->filename, sumname, sizeof (sumname)) < 0)
+    {
+	perror(output->filename);
+	return;
+    }
+    if ((fp = fopen(sumname, "r")) != NULL)
+    {
+	n = fscanf(fp, "%lx %ld", &crc, &length);
+	fclose(fp);
+	if ((n == 2) && (length == output->writer.start_length))
+	{
+	    output->base_checksum = crc;
+	    return;
+	}
+    }
+
+    DEBUG(("Checksumming the existing %ld bytes of \"%s\"\n",
+	   (long)output->writer.start_length, output->filename));
+    if ((fd = open(output->filename, O_RDONLY)) < 0)
+    {
+	perror(output->filename);
+	return;
+    }
+    for (remaining = output->writer.start_length; remaining > 0; remaining -= n)
+    {
+	n = read(fd, buf, (remaining < (off_t)sizeof (buf)) ? (size_t)remaining : sizeof (buf));
+	if (n <= 0)
+	{
+	    break;
+	}
+	output->base_checksum = crc32c(output->base_checksum, buf, n);
+    }
+    close(fd);
+}
+
+/* Write the checksum sidecar of the current log file of an output,
+ * which is about to be closed.  The sidecar is replaced atomically.
+ */
+void
+checksum_record(LOG_OUTPUT *output)
+{
+    LOG_WRITER	*writer = &output->writer;
+    char	sumname[MAX_PATH];
+    char	tmpname[MAX_PATH + 8];
+    FILE	*fp;
+
+    if (!output->write_sum || (writer->fd < 0))
+    {
+	return;
+    }
+    if (checksum_filename(output->filename, sumname, sizeof (sumname)) < 0)
+    {
+	perror(output->filename);
+	return;
+    }
+    snprintf(tmpname, sizeof (tmpname), "%s.%d", sumname, (int)getpid());
+    if ((fp = fopen(tmpname, "w")) == NULL)
+    {
+	perror(tmpname);
+	return;
+    }
+    fprintf(fp, "%08lx %ld\n",
+	    crc32c_combine(output->base_checksum, writer->checksum,
+			   writer->length - writer->start_length),
+	    (long)writer->length);
+    if ((fclose(fp) != 0) || (rename(tmpname, sumname) < 0))
+    {
+	perror(sumname);
+	unlink(tmpname);
+    }
+}
+
+/* Append a record for the current log file of an output, which is
+ * about to be closed.
+ */
+void
+catalog_record(LOG_OUTPUT *output)
+{
+    LOG_WRITER	*writer = &output->writer;
+    char	record[MAX_PATH + 256];
+    int		len;
+
+    if ((output->catalog_fd < 0) || (writer->fd < 0))
+    {
+	return;
+    }
+    len = snprintf(record, sizeof (record), "%s\t%ld\t%ld\t%ld\t%ld\t%ld\t%ld\t%ld\t%08lx\n",
+		   output->filename,
+		   (long)output->period_start, (long)output->next_period,
+		   (long)writer->start_length, (long)(writer->length - writer->start_length),
+		   writer->lines,
+		   (long)output->first_write, (long)output->last_write,
+		   writer->checksum);
+    if (write(output->catalog_fd, record, len) != len)
+    {
+	perror(output->catalog);
+    }
+}
@@ -0,0 +1,356 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronocheckpoint -- resumable splitting of log files for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * When existing log files are split with a checkpoint file
+ * ("cronolog -r file -i input ..."), records of the progress of the
+ * split are appended to the checkpoint file, so that if cronolog is
+ * interrupted it can carry on from the last checkpoint rather than
+ * starting again with log files that already hold part of the data.
+ *
+ * Before a log file is written to, an "open" record is appended with
+ * its length at that time.  Every CHECKPOINT_BYTES of input a "mark"
+ * is appended: a "length" record for each log file open, then a
+ * record of the input file and the offset in it up to which every
+ * line has been written.  Each record carries a CRC-32C, so that a
+ * record torn by a crash ends the file.  Records are synced to disk
+ * (and the log files before a mark) so that they survive a system
+ * crash as well.
+ *
+ * When cronolog starts with a checkpoint file that holds a mark, the
+ * log files written since the last mark are truncated to their
+ * lengths at the mark (or when they were first opened after it; as a
+ * log file only grows after a mark, this is the smallest length
+ * recorded for it since the mark) and the split starts again from the
+ * offset of the mark.  The checkpoint file is removed when the split
+ * finishes.
+ */
+
+#include "cronoutils.h"
+
+
+#define CHECKPOINT_OPEN		1	/* offset = length of a log file opened */
+#define CHECKPOINT_LENGTH	2	/* offset = length of an open log file */
+#define CHECKPOINT_MARK		3	/* offset = offset in input file "input" */
+
+typedef struct
+{
+    int			type;
+    int			input;		/* number of the input file */
+    off_t		offset;
+    time_t		time;		/* time of the line before a mark */
+    unsigned long	crc;		/* CRC-32C of the record with crc 0 */
+    char		name[MAX_PATH];	/* log file or input file */
+}
+CHECKPOINT_RECORD;
+
+
+static const char	*checkpoint_name = NULL;
+static int		checkpoint_fd = -1;
+
+
+/* Fill in a record and its CRC.
+ */
+static void
+make_record(CHECKPOINT_RECORD *record, int type, int input, off_t offset, time_t time,
+	    const char *name)
+{
+    memset(record, 0, sizeof (*record));
+    record->type   = type;
+    record->input  = input;
+    record->offset = offset;
+    record->time   = time;
+    strncpy(record->name, name, sizeof (record->name) - 1);
+    record->crc    = crc32c(0, (const char *)record, sizeof (*record));
+}
+
+/* Append records to the checkpoint file and sync them to disk.
+ */
+static void
+write_records(const CHECKPOINT_RECORD *records, int n_records)
+{
+    size_t	len = n_records * sizeof (CHECKPOINT_RECORD);
+
+    if ((write(checkpoint_fd, records, len) != (ssize_t)len) || (fsync(checkpoint_fd) < 0))
+    {
+	perror(checkpoint_name);
+	exit(2);
+    }
+}
+
+/* Read the records of a checkpoint file up to the first torn record.
+ *
+ * Returns the number of records read (*precords is set to an array of
+ * them), or -1 on error.
+ */
+static int
+read_records(int fd, CHECKPOINT_RECORD **precords)
+{
+    CHECKPOINT_RECORD	*records = NULL;
+    CHECKPOINT_RECORD	record;
+    unsigned long	crc;
+    int			n_records = 0;
+    int			size = 0;
+
+    while (read(fd, &record, sizeof (record)) == sizeof (record))
+    {
+	crc = record.crc;
+	record.crc = 0;
+	if (crc32c(0, (const char *)&record, sizeof (record)) != crc)
+	{
+	    DEBUG(("Torn record %d in the checkpoint file\n", n_records));
+	    break;
+	}
+	if (n_records == size)
+	{
+	    size = size ? 2 * size : 64;
+	    if ((records = realloc(records, size * sizeof (record))) == NULL)
+	    {
+		return -1;
+	    }
+	}
+	records[n_records++] = record;
+    }
+    *precords = records;
+    return n_records;
+}
+
+/* Open a checkpoint file for splitting a list of input files.  If the
+ * file holds a mark from an earlier split of the same input files,
+ * truncate the log files written since the mark to their lengths at
+ * the mark and return the input file and offset from which to carry
+ * on, and the time of the line before it; otherwise return the start
+ * of the first file.  The checkpoint
+ * file is then started again with a mark at that point.
+ *
+ * Returns 0 on success or -1 on error (with a message printed).
+ */
+int
+checkpoint_open(const char *path, char **inputs, int n_inputs, int *pinput, off_t *poffset,
+		time_t *ptime)
+{
+    CHECKPOINT_RECORD	*records = NULL;
+    CHECKPOINT_RECORD	record;
+    struct stat		stat_buf;
+    char		newpath[MAX_PATH];
+    int			n_records = 0;
+    int			mark = -1;
+    int			group;
+    int			fd;
+    int			i;
+
+    checkpoint_name = path;
+    *pinput  = 0;
+    *poffset = 0;
+    *ptime   = -1;
+
+    if ((fd = open(path, O_RDONLY)) >= 0)
+    {
+	n_records = read_records(fd, &records);
+	close(fd);
+	if (n_records < 0)
+	{
+	    perror(path);
+	    return -1;
+	}
+
+	/* Find the last mark and the length records that go with it */
+
+	for (i = 0; i < n_records; i++)
+	{
+	    if (records[i].type == CHECKPOINT_MARK)
+	    {
+		mark = i;
+	    }
+	}
+	if (mark >= 0)
+	{
+	    if (   (records[mark].input >= n_inputs)
+		|| (strcmp(records[mark].name, inputs[records[mark].input]) != 0))
+	    {
+		fprintf(stderr, "%s: checkpoint is for a different input (%s)\n",
+			path, records[mark].name);
+		free(records);
+		return -1;
+	    }
+	    for (group = mark; (group > 0) && (records[group - 1].type == CHECKPOINT_LENGTH); group--)
+	    {
+		;
+	    }
+	    for (i = group; i < n_records; i++)
+	    {
+		if (   (records[i].type != CHECKPOINT_MARK)
+		    && (stat(records[i].name, &stat_buf) == 0)
+		    && (stat_buf.st_size > records[i].offset))
+		{
+		    DEBUG(("Truncating \"%s\" to %ld bytes\n", records[i].name,
+			   (long)records[i].offset));
+		    if (truncate(records[i].name, records[i].offset) < 0)
+		    {
+			perror(records[i].name);
+			free(records);
+			return -1;
+		    }
+		}
+	    }
+	    *pinput  = records[mark].input;
+	    *poffset = records[mark].offset;
+	    *ptime   = records[mark].time;
+	    fprintf(stderr, "%s: resuming from offset %ld of %s\n", path,
+		    (long)*poffset, inputs[*pinput]);
+	}
+	free(records);
+    }
+
+    /* Start the checkpoint file again, replacing the old one only
+     * once the new one holds the mark.
+     */
+    snprintf(newpath, sizeof (newpath), "%s.new", path);
+    if ((checkpoint_fd = open(newpath, O_WRONLY|O_CREAT|O_TRUNC, FILE_MODE)) < 0)
+    {
+	perror(newpath);
+	return -1;
+    }
+    make_record(&record, CHECKPOINT_MARK, *pinput, *poffset, *ptime, inputs[*pinput]);
+    write_records(&record, 1);
+    if (rename(newpath, path) < 0)
+    {
+	perror(path);
+	return -1;
+    }
+    return 0;
+}
+
+/* Record the length of a log file about to be written to.
+ */
+void
+checkpoint_opened(const char *filename, off_t length)
+{
+    CHECKPOINT_RECORD	record;
+
+    if (checkpoint_fd < 0)
+    {
+	return;
+    }
+    make_record(&record, CHECKPOINT_OPEN, 0, length, 0, filename);
+    write_records(&record, 1);
+}
+
+/* Record that every line of the input files before an offset in one
+ * of them (the last of them logged at time last_time) has been written
+ * to the log files, after syncing the open log files.
+ */
+void
+checkpoint_mark(LOG_OUTPUT *outputs, int n_outputs, char **inputs, int input, off_t offset,
+		time_t last_time)
+{
+    CHECKPOINT_RECORD	*records;
+    LOG_OUTPUT		*output;
+    int			n_records = 0;
+
+    if (checkpoint_fd < 0)
+    {
+	return;
+    }
+    if ((records = malloc((n_outputs + 1) * sizeof (CHECKPOINT_RECORD))) == NULL)
+    {
+	perror(checkpoint_name);
+	exit(2);
+    }
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (output->writer.fd < 0)
+	{
+	    continue;
+	}
+	if (fsync(output->writer.fd) < 0)
+	{
+	    perror(output->filename);
+	    exit(5);
+	}
+	make_record(&records[n_records++], CHECKPOINT_LENGTH, 0,
+		    output->writer.length, 0, output->filename);
+    }
+    make_record(&records[n_records++], CHECKPOINT_MARK, input, offset, last_time,
+		inputs[input]);
+    write_records(records, n_records);
+    free(records);
+    DEBUG(("Checkpoint at offset %ld of %s\n", (long)offset, inputs[input]));
+}
+
+/* Remove the checkpoint file once the split has finished.
+ */
+void
+checkpoint_done(void)
+{
+    if (checkpoint_fd < 0)
+    {
+	return;
+    }
+    close(checkpoint_fd);
+    checkpoint_fd = -1;
+    unlink(checkpoint_name);
+}
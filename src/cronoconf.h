@@ -31,6 +31,204 @@
 #define MAX_PATH		1024
 #endif
 
+/* Size of the windows by which log files are extended when they are
+ * written through mmap (must be a multiple of the page size) */
+
+#ifndef MMAP_WINDOW_SIZE
+#define MMAP_WINDOW_SIZE	(8 * 1024 * 1024)
+#endif
+
+/* Suffix of the checksum sidecar file written alongside each log file */
+
+#ifndef SUM_SUFFIX
+#define SUM_SUFFIX		".sum"
+#endif
+
+/* Longest time for which a gzip frame is kept open (so that the
+ * time range covered by each frame is bounded) */
+
+#ifndef FRAME_MAX_SECONDS
+#define FRAME_MAX_SECONDS	60
+#endif
+
+/* Suffix of the time index file written alongside each log file */
+
+#ifndef INDEX_SUFFIX
+#define INDEX_SUFFIX		".idx"
+#endif
+
+/* Number of files searched in parallel by "cronolog --query", and the
+ * time by which a line may be written after its timestamp */
+
+#ifndef QUERY_THREADS
+#define QUERY_THREADS		4
+#endif
+
+#ifndef QUERY_SLACK
+#define QUERY_SLACK		(5 * SECS_PER_MIN)
+#endif
+
+/* Size of the memory pool in which log data is held back when a log
+ * file cannot be written, the interval at which writing the log file
+ * is retried and the suffix of the files in the fallback directory */
+
+#ifndef SPILL_POOL_SIZE
+#define SPILL_POOL_SIZE		(16 * 1024 * 1024)
+#endif
+
+#ifndef SPILL_RETRY
+#define SPILL_RETRY		10
+#endif
+
+#ifndef SPILL_SUFFIX
+#define SPILL_SUFFIX		".spill"
+#endif
+
+/* Size of the ring buffer of a new write-ahead journal and the
+ * maximum number of log files (templates times shards) it can serve */
+
+#ifndef JOURNAL_SIZE
+#define JOURNAL_SIZE		(16 * 1024 * 1024)
+#endif
+
+#ifndef JOURNAL_OUTPUTS
+#define JOURNAL_OUTPUTS		64
+#endif
+
+/* Maximum length of the timestamp prefix of a line and the number of
+ * lines passed to the writer at a time when lines are prefixed */
+
+#ifndef STAMP_MAX
+#define STAMP_MAX		256
+#endif
+
+#ifndef STAMP_LINES
+#define STAMP_LINES		512
+#endif
+
+/* Lines up to STAMP_COPY_MAX bytes long are copied with their prefix
+ * into a staging buffer of STAMP_STAGE bytes rather than passed to the
+ * writer as buffers of their own */
+
+#ifndef STAMP_COPY_MAX
+#define STAMP_COPY_MAX		512
+#endif
+
+#ifndef STAMP_STAGE
+#define STAMP_STAGE		65536
+#endif
+
+/* Number of different links whose targets are recorded in the shared
+ * segment of a template (see cronoshared.c) */
+
+#ifndef SHARED_LINKS
+#define SHARED_LINKS		8
+#endif
+
+/* Number of records in the trace ring (a power of two) and the number
+ * of characters of a file name kept in a record */
+
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS		65536
+#endif
+
+#ifndef TRACE_NAME
+#define TRACE_NAME		48
+#endif
+
+/* Precision of the latency histograms (each power of two is divided
+ * into 2^(HIST_SUB_BITS - 1) buckets) and the largest duration they
+ * can tell apart (2^HIST_MAX_BITS nanoseconds, about 18 minutes) */
+
+#ifndef HIST_SUB_BITS
+#define HIST_SUB_BITS		7
+#endif
+
+#ifndef HIST_MAX_BITS
+#define HIST_MAX_BITS		40
+#endif
+
+/* Number of threads that decompress input files for --input, and
+ * the number of BUFSIZE blocks each file may have decompressed ahead
+ * of the splitter */
+
+#ifndef INPUT_THREADS
+#define INPUT_THREADS		4
+#endif
+
+#ifndef INPUT_QUEUE
+#define INPUT_QUEUE		16
+#endif
+
+/* Size of the chunks into which a large input file is divided to be
+ * split in parallel (--jobs), and the number of chunks that may be
+ * parsed ahead of the chunk being copied to the log files */
+
+#ifndef RANGE_CHUNK_SIZE
+#define RANGE_CHUNK_SIZE		(64 * 1024 * 1024)
+#endif
+
+#ifndef RANGE_AHEAD
+#define RANGE_AHEAD		16
+#endif
+
+/* Size of the shared memory ring created for --ring (a power of 2),
+ * and how often the ring is polled if there is no thread to wait for
+ * it */
+
+#ifndef RING_SIZE
+#define RING_SIZE		(4 * 1024 * 1024)
+#endif
+
+#ifndef RING_POLL_MS
+#define RING_POLL_MS		10
+#endif
+
+/* Sockets listened on with --listen and --listen-dgram: the number
+ * of datagrams taken with each recvmmsg() call and the largest
+ * datagram taken whole (less than BUFSIZE), the number of events
+ * taken with each epoll_wait() call and the longest tag */
+
+#ifndef LISTEN_BATCH
+#define LISTEN_BATCH		32
+#endif
+
+#ifndef LISTEN_DGRAM_SIZE
+#define LISTEN_DGRAM_SIZE	16384
+#endif
+
+#ifndef LISTEN_EVENTS
+#define LISTEN_EVENTS		64
+#endif
+
+#ifndef LISTEN_TAG_MAX
+#define LISTEN_TAG_MAX		64
+#endif
+
+/* Socket of the cronolog daemon to which cronolog-attach hands its
+ * pipe unless told otherwise, and the longest request it can send */
+
+#ifndef ATTACH_SOCKET
+#define ATTACH_SOCKET		"/var/run/cronolog.sock"
+#endif
+
+#ifndef ATTACH_MAX
+#define ATTACH_MAX		8192
+#endif
+
+/* Amount of input split between checkpoints (--resume) */
+
+#ifndef CHECKPOINT_BYTES
+#define CHECKPOINT_BYTES	(64 * 1024 * 1024)
+#endif
+
+/* Number of consecutive periods without log files after which the
+ * retention worker stops looking for older files */
+
+#ifndef RETAIN_GAP
+#define RETAIN_GAP		32
+#endif
+
 /* Default permissions for files and directories that are created */
 
 #ifndef FILE_MODE
@@ -0,0 +1,396 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronocrc -- CRC-32C checksums for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * The checksum of the data written to each log file is computed as it
+ * is written, so that archived logs can be verified without reading
+ * them back.  CRC-32C (Castagnoli) is used as it is what iSCSI, ext4
+ * and many storage tools use, e.g. "crc32c FILE" gives the same value,
+ * and because x86 processors since SSE4.2 compute it in hardware.
+ *
+ * On x86-64 processors with SSE4.2 (checked at run time) the crc32
+ * instruction is used eight bytes at a time, on three streams of data
+ * at once (as in Mark Adler's crc32c.c); elsewhere the checksum is
+ * calculated eight bytes at a time with the "slicing-by-8" tables.
+ * Either way it costs a small fraction of the time taken to write the
+ * data.
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_SSE42_CRC32	1
+#endif
+
+
+/* Tables for the slicing-by-8 calculation (reflected polynomial
+ * 0x82F63B78), built on first use (once only, as libcronolog may be
+ * used by several threads).
+ */
+static unsigned long	crc32c_table[8][256];
+#if HAVE_PTHREAD_H
+static pthread_once_t	crc32c_once = PTHREAD_ONCE_INIT;
+#else
+static int		crc32c_initialized = 0;
+#endif
+
+#if HAVE_SSE42_CRC32
+/* The hardware calculation runs on three blocks of CRC32C_LONG (then
+ * CRC32C_SHORT) bytes at once, as the crc32 instruction can start
+ * every cycle but takes three cycles to finish; the CRCs of the blocks
+ * are then combined with these tables, which shift a CRC over that
+ * many zero bytes.
+ */
+#define CRC32C_LONG	8192
+#define CRC32C_SHORT	256
+
+static unsigned long	crc32c_long[4][256];
+static unsigned long	crc32c_short[4][256];
+static int		use_sse42 = 0;
+#endif
+
+/* Multiply a vector over GF(2) by a 32x32 matrix (as in zlib's
+ * crc32_combine).
+ */
+static unsigned long
+gf2_times(const unsigned long *mat, unsigned long vec)
+{
+    unsigned long	sum = 0;
+
+    while (vec)
+    {
+	if (vec & 1)
+	{
+	    sum ^= *mat;
+	}
+	vec >>= 1;
+	mat++;
+    }
+    return sum;
+}
+
+static void
+gf2_square(unsigned long *square, const unsigned long *mat)
+{
+    int		n;
+
+    for (n = 0; n < 32; n++)
+    {
+	square[n] = gf2_times(mat, mat[n]);
+    }
+}
+
+#if HAVE_SSE42_CRC32
+/* Build the tables that shift a CRC over len zero bytes (a power of
+ * two), taking the CRC a byte at a time.
+ */
+static void
+crc32c_zeros(unsigned long zeros[4][256], size_t len)
+{
+    unsigned long	even[32];
+    unsigned long	odd[32];
+    unsigned long	*op = even;
+    unsigned long	*square = odd;
+    unsigned long	*swap;
+    unsigned long	row;
+    int			n;
+
+    /* Operator for one zero bit in odd, then two, four and eight in
+     * turn, then squared up to len zero bytes
+     */
+    odd[0] = 0x82F63B78UL;
+    for (n = 1, row = 1; n < 32; n++, row <<= 1)
+    {
+	odd[n] = row;
+    }
+    gf2_square(even, odd);
+    gf2_square(odd, even);
+    gf2_square(even, odd);
+    for (; len > 1; len >>= 1)
+    {
+	gf2_square(square, op);
+	swap   = op;
+	op     = square;
+	square = swap;
+    }
+    for (n = 0; n < 256; n++)
+    {
+	zeros[0][n] = gf2_times(op, n);
+	zeros[1][n] = gf2_times(op, (unsigned long)n << 8);
+	zeros[2][n] = gf2_times(op, (unsigned long)n << 16);
+	zeros[3][n] = gf2_times(op, (unsigned long)n << 24);
+    }
+}
+#endif
+
+static void
+init_crc32c(void)
+{
+    unsigned long	crc;
+    int			i;
+    int			j;
+
+    for (i = 0; i < 256; i++)
+    {
+	crc = i;
+	for (j = 0; j < 8; j++)
+	{
+	    crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78UL) : (crc >> 1);
+	}
+	crc32c_table[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++)
+    {
+	for (j = 1; j < 8; j++)
+	{
+	    crc32c_table[j][i] = (  (crc32c_table[j-1][i] >> 8)
+				  ^ crc32c_table[0][crc32c_table[j-1][i] & 0xff]);
+	}
+    }
+#if HAVE_SSE42_CRC32
+    __builtin_cpu_init();
+    use_sse42 = __builtin_cpu_supports("sse4.2");
+    if (use_sse42)
+    {
+	crc32c_zeros(crc32c_long, CRC32C_LONG);
+	crc32c_zeros(crc32c_short, CRC32C_SHORT);
+    }
+#endif
+#if !HAVE_PTHREAD_H
+    crc32c_initialized = 1;
+#endif
+}
+
+#if HAVE_SSE42_CRC32
+/* Hardware calculation with the SSE4.2 crc32 instruction of three
+ * consecutive blocks of data at once, returning their combined CRC.
+ */
+__attribute__((target("sse4.2")))
+static unsigned long long
+crc32c_sse42_blocks(unsigned long long crc0, const unsigned char *p, size_t block,
+		    unsigned long zeros[4][256])
+{
+    const unsigned char	*end = p + block;
+    unsigned long long	crc1 = 0;
+    unsigned long long	crc2 = 0;
+    unsigned long long	word;
+
+    do
+    {
+	memcpy(&word, p, 8);
+	crc0 = __builtin_ia32_crc32di(crc0, word);
+	memcpy(&word, p + block, 8);
+	crc1 = __builtin_ia32_crc32di(crc1, word);
+	memcpy(&word, p + 2 * block, 8);
+	crc2 = __builtin_ia32_crc32di(crc2, word);
+	p += 8;
+    }
+    while (p < end);
+
+    crc0 = (  zeros[0][crc0 & 0xff]         ^ zeros[1][(crc0 >> 8) & 0xff]
+	    ^ zeros[2][(crc0 >> 16) & 0xff] ^ zeros[3][crc0 >> 24]) ^ crc1;
+    crc0 = (  zeros[0][crc0 & 0xff]         ^ zeros[1][(crc0 >> 8) & 0xff]
+	    ^ zeros[2][(crc0 >> 16) & 0xff] ^ zeros[3][crc0 >> 24]) ^ crc2;
+    return crc0;
+}
+
+/* Hardware calculation with the SSE4.2 crc32 instruction.
+ */
+__attribute__((target("sse4.2")))
+static unsigned long
+crc32c_sse42(unsigned long crc, const unsigned char *p, size_t len)
+{
+    unsigned long long	crc64 = crc;
+    unsigned long long	word;
+
+    while (len && ((unsigned long)p & 7))
+    {
+	crc64 = __builtin_ia32_crc32qi((unsigned int)crc64, *p++);
+	len--;
+    }
+    for (; len >= 3 * CRC32C_LONG; p += 3 * CRC32C_LONG, len -= 3 * CRC32C_LONG)
+    {
+	crc64 = crc32c_sse42_blocks(crc64, p, CRC32C_LONG, crc32c_long);
+    }
+    for (; len >= 3 * CRC32C_SHORT; p += 3 * CRC32C_SHORT, len -= 3 * CRC32C_SHORT)
+    {
+	crc64 = crc32c_sse42_blocks(crc64, p, CRC32C_SHORT, crc32c_short);
+    }
+    while (len >= 8)
+    {
+	memcpy(&word, p, 8);
+	crc64 = __builtin_ia32_crc32di(crc64, word);
+	p   += 8;
+	len -= 8;
+    }
+    while (len--)
+    {
+	crc64 = __builtin_ia32_crc32qi((unsigned int)crc64, *p++);
+    }
+    return (unsigned long)crc64;
+}
+#endif
+
+/* Update a CRC-32C with a buffer of data.  The initial value for a
+ * new checksum is 0.
+ */
+unsigned long
+crc32c(unsigned long crc, const char *buf, size_t len)
+{
+    const unsigned char	*p = (const unsigned char *)buf;
+    unsigned long	lo;
+    unsigned long	hi;
+
+#if HAVE_PTHREAD_H
+    pthread_once(&crc32c_once, init_crc32c);
+#else
+    if (!crc32c_initialized)
+    {
+	init_crc32c();
+    }
+#endif
+    crc = ~crc & 0xffffffffUL;
+#if HAVE_SSE42_CRC32
+    if (use_sse42)
+    {
+	return ~crc32c_sse42(crc, p, len) & 0xffffffffUL;
+    }
+#endif
+    while (len >= 8)
+    {
+	lo  = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24));
+	hi  = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned long)p[7] << 24);
+	crc = (  crc32c_table[7][lo & 0xff]         ^ crc32c_table[6][(lo >> 8) & 0xff]
+	       ^ crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24]
+	       ^ crc32c_table[3][hi & 0xff]         ^ crc32c_table[2][(hi >> 8) & 0xff]
+	       ^ crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24]);
+	p   += 8;
+	len -= 8;
+    }
+    while (len--)
+    {
+	crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc & 0xffffffffUL;
+}
+
+/* Combine the CRC-32C of two consecutive pieces of data, given the
+ * length of the second, without access to the data.  Used to extend
+ * the checksum of a log file that was partly written by an earlier
+ * process.
+ */
+unsigned long
+crc32c_combine(unsigned long crc1, unsigned long crc2, off_t len2)
+{
+    unsigned long	even[32];
+    unsigned long	odd[32];
+    unsigned long	row;
+    int			n;
+
+    if (len2 <= 0)
+    {
+	return crc1;
+    }
+
+    /* Operator for one zero bit in odd, then two and four in even */
+
+    odd[0] = 0x82F63B78UL;
+    for (n = 1, row = 1; n < 32; n++, row <<= 1)
+    {
+	odd[n] = row;
+    }
+    gf2_square(even, odd);
+    gf2_square(odd, even);
+
+    /* Apply len2 zero bytes to crc1 */
+
+    do
+    {
+	gf2_square(even, odd);
+	if (len2 & 1)
+	{
+	    crc1 = gf2_times(even, crc1);
+	}
+	len2 >>= 1;
+	if (len2 == 0)
+	{
+	    break;
+	}
+	gf2_square(odd, even);
+	if (len2 & 1)
+	{
+	    crc1 = gf2_times(odd, crc1);
+	}
+	len2 >>= 1;
+    }
+    while (len2);
+
+    return crc1 ^ crc2;
+}
@@ -0,0 +1,125 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronodump -- print a cronolog trace dump
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * Prints the events recorded in a trace file written by "cronolog -X
+ * file" (see cronotrace.c), oldest first, one per line.  The dump
+ * must be read on a host of the same architecture as the one that
+ * wrote it.
+ *
+ * Usage:
+ *
+ * 	cronodump [file]
+ */
+
+#include "cronoutils.h"
+
+
+#define USAGE_MSG 	"usage: %s [trace-file]\n"
+
+
+int
+main(int argc, char **argv)
+{
+    TRACE_HEADER	header;
+    TRACE_RECORD	record;
+    FILE		*fp = stdin;
+    char		line[MAX_PATH];
+    int			i;
+
+    if (argc > 2)
+    {
+	fprintf(stderr, USAGE_MSG, argv[0]);
+	exit(1);
+    }
+    if ((argc == 2) && (fp = fopen(argv[1], "rb")) == NULL)
+    {
+	perror(argv[1]);
+	exit(1);
+    }
+    if (   (fread(&header, sizeof (header), 1, fp) != 1)
+	|| (memcmp(header.magic, TRACE_MAGIC, sizeof (header.magic)) != 0))
+    {
+	fprintf(stderr, "%s: not a cronolog trace dump\n", argv[0]);
+	exit(1);
+    }
+    if (header.record_size != sizeof (TRACE_RECORD))
+    {
+	fprintf(stderr, "%s: trace dump was written on a different architecture\n", argv[0]);
+	exit(1);
+    }
+    for (i = 0; i < header.n_records; i++)
+    {
+	if (fread(&record, sizeof (record), 1, fp) != 1)
+	{
+	    fprintf(stderr, "%s: trace dump is truncated\n", argv[0]);
+	    exit(1);
+	}
+	trace_format(&record, line, sizeof (line));
+	printf("%s\n", line);
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronohist -- latency histograms for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * The histograms record durations in nanoseconds in the manner of
+ * HdrHistogram: values below 2^HIST_SUB_BITS each have a bucket of
+ * their own, and above that every power of two is divided into
+ * 2^(HIST_SUB_BITS - 1) buckets of equal width, so that any value is
+ * known to within 1 part in 2^(HIST_SUB_BITS - 1) whatever its size.
+ * A histogram is a fixed array of counts (values of 2^HIST_MAX_BITS
+ * or more are counted in the last bucket) and recording a value is a
+ * few shifts and an increment.
+ *
+ * A histogram is only ever updated and read by the main loop of the
+ * program, so no locking is needed; signal handlers only ask for a
+ * report.
+ */
+
+#include "cronoutils.h"
+
+
+#define HIST_HALF	(1 << (HIST_SUB_BITS - 1))
+
+
+/* Return the bucket of a value.
+ */
+static int
+hist_bucket(unsigned long long value)
+{
+    int		shift = 0;
+
+    if (value >= (1ULL << HIST_MAX_BITS))
+    {
+	return HIST_BUCKETS - 1;
+    }
+    while ((value >> shift) >= (1ULL << HIST_SUB_BITS))
+    {
+	shift++;
+    }
+    return shift * HIST_HALF + (int)(value >> shift);
+}
+
+/* Return the highest value counted in a bucket.
+ */
+static unsigned long long
+hist_bucket_max(int bucket)
+{
+    int		shift = (bucket < 2 * HIST_HALF) ? 0 : bucket / HIST_HALF - 1;
+
+    return ((unsigned long long)(bucket - shift * HIST_HALF + 1) << shift) - 1;
+}
+
+/* Return the current time in nanoseconds from an arbitrary start,
+ * for measuring durations.
+ */
+unsigned long long
+hist_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    struct timeval	tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+}
+
+/* Count a value in a histogram.
+ */
+void
+hist_record(HISTOGRAM *hist, unsigned long long value)
+{
+    hist->counts[hist_bucket(value)]++;
+    if ((hist->total == 0) || (value < hist->min))
+    {
+	hist->min = value;
+    }
+    if (value > hist->max)
+    {
+	hist->max = value;
+    }
+    hist->total++;
+}
+
+/* Return the value below which the given percentage of the values
+ * counted fall (to the precision of the buckets).
+ */
+unsigned long long
+hist_percentile(const HISTOGRAM *hist, double percent)
+{
+    unsigned long	rank;
+    unsigned long	seen = 0;
+    int			i;
+
+    if (hist->total == 0)
+    {
+	return 0;
+    }
+    rank = (unsigned long)(percent / 100.0 * hist->total + 0.5);
+    if (rank < 1)
+    {
+	rank = 1;
+    }
+    for (i = 0; i < HIST_BUCKETS - 1; i++)
+    {
+	seen += hist->counts[i];
+	if ((seen >= rank) && (hist_bucket_max(i) < hist->max))
+	{
+	    return hist_bucket_max(i);
+	}
+	if (seen >= rank)
+	{
+	    break;
+	}
+    }
+    return hist->max;
+}
+
+/* Forget the values counted in a histogram.
+ */
+void
+hist_reset(HISTOGRAM *hist)
+{
+    memset(hist, 0, sizeof (*hist));
+}
+
+/* Print a line summarizing a histogram: the number of values and the
+ * minimum, percentiles and maximum in microseconds.
+ */
+void
+hist_print(FILE *fp, const char *name, const HISTOGRAM *hist)
+{
+    static double	percents[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+    int			i;
+
+    fprintf(fp, "%-8s n=%lu min=%.1fus", name, hist->total, hist->min / 1000.0);
+    for (i = 0; i < (int)(sizeof (percents) / sizeof (percents[0])); i++)
+    {
+	fprintf(fp, " p%g=%.1fus", percents[i], hist_percentile(hist, percents[i]) / 1000.0);
+    }
+    fprintf(fp, " max=%.1fus\n", hist->max / 1000.0);
+}
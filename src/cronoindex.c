@@ -0,0 +1,188 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoindex -- time index files for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * Alongside each log file cronolog can maintain a sparse index file,
+ * named after the log file with INDEX_SUFFIX appended, which maps
+ * times to offsets in the log file.  Each record is a line of the form
+ *
+ *	TIME OFFSET
+ *
+ * where TIME is the time (in seconds since the epoch) at which the
+ * data starting at byte OFFSET of the log file was read.  A record is
+ * written for the first data written to the file by this process and
+ * then whenever the configured interval of time or data has passed.
+ *
+ * If the log file is written as gzip frames then a record is written
+ * for the start of each frame instead, with OFFSET being the offset
+ * of the frame in the compressed file.
+ *
+ * The index is only ever appended to, with a single write() per
+ * record, so it remains usable if cronolog is killed; a reader should
+ * ignore an incomplete last line.
+ */
+
+#include "cronoutils.h"
+
+
+/* Open (or create) the index file for the current log file of an
+ * output.  Failure to open the index is reported but is not fatal.
+ */
+void
+index_open(LOG_OUTPUT *output)
+{
+    char	filename[MAX_PATH];
+
+    if (!output->index_interval && !output->index_bytes && !output->frame_size)
+    {
+	return;
+    }
+    if (index_filename(output->filename, filename, sizeof (filename)) < 0)
+    {
+	perror(output->filename);
+	return;
+    }
+    output->index_fd = open(filename, O_WRONLY|O_CREAT|O_APPEND, FILE_MODE);
+    if (output->index_fd < 0)
+    {
+	perror(filename);
+	return;
+    }
+    output->index_time   = 0;
+    output->index_offset = -1;
+    DEBUG(("Writing time index to \"%s\"\n", filename));
+}
+
+/* Record the current time and log file offset in the index if the
+ * index interval has passed since the last record.
+ */
+void
+index_note(LOG_OUTPUT *output, time_t time_now)
+{
+    off_t	offset = output->writer.length;
+
+    if (   (output->index_fd < 0)
+	|| (   (output->index_offset >= 0)
+	    && (   !output->index_interval
+		|| (time_now < output->index_time + output->index_interval))
+	    && (   !output->index_bytes
+		|| (offset < output->index_offset + output->index_bytes))))
+    {
+	return;
+    }
+    index_record(output, time_now, offset);
+}
+
+/* Write an index record.
+ */
+void
+index_record(LOG_OUTPUT *output, time_t time_now, off_t offset)
+{
+    char	record[64];
+    int		len;
+
+    if (output->index_fd < 0)
+    {
+	return;
+    }
+    len = sprintf(record, "%ld %ld\n", (long)time_now, (long)offset);
+    if (write(output->index_fd, record, len) != len)
+    {
+	fprintf(stderr, "cannot write index for \"%s\"\n", output->filename);
+	close(output->index_fd);
+	output->index_fd = -1;
+	return;
+    }
+    output->index_time   = time_now;
+    output->index_offset = offset;
+}
+
+/* Close the index file of an output.
+ */
+void
+index_close(LOG_OUTPUT *output)
+{
+    if (output->index_fd >= 0)
+    {
+	close(output->index_fd);
+	output->index_fd = -1;
+    }
+}
+
+/* Construct the name of the index file for a log file.  Returns -1
+ * (with errno set to ENAMETOOLONG) if the name does not fit.
+ */
+int
+index_filename(const char *filename, char *pindexname, size_t pindexname_len)
+{
+    if (   (size_t)snprintf(pindexname, pindexname_len, "%s%s", filename, INDEX_SUFFIX)
+	>= pindexname_len)
+    {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,888 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoinput -- reading of (compressed) input files for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * When existing log files are split into periods ("cronolog -i file
+ * ...") the input files are read and, if they are compressed with
+ * gzip, bzip2 or zstd (recognized by their first bytes, not by their
+ * names), decompressed in this process rather than through a pipe
+ * from a separate program.
+ *
+ * The files are decompressed by up to INPUT_THREADS threads, each
+ * repeatedly taking a block of the first file that has room in its
+ * queue, while the main thread reads them.  Each file has a queue of
+ * INPUT_QUEUE blocks of decompressed data, so that the threads cannot
+ * get ahead of the reader by more than that, while the reader rarely
+ * has to wait for data.  When the files are split one after the other
+ * only the next few of them are read ahead; when they are merged
+ * ("cronolog -g -i file ...") all of them are read side by side and
+ * their lines are taken in time order through a heap.
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#if HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+#if HAVE_BZLIB_H
+#include <bzlib.h>
+#endif
+#if HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+
+
+/* The state of the decompression of one input file */
+
+typedef struct
+{
+    INPUT_TYPE	type;
+    int		fd;
+    int		eof;		/* the end of the file has been read */
+    size_t	in_pos;		/* compressed data not yet decompressed */
+    size_t	in_len;
+#if HAVE_ZLIB_H
+    z_stream	gz;
+#endif
+#if HAVE_BZLIB_H
+    bz_stream	bz;
+#endif
+#if HAVE_ZSTD_H
+    ZSTD_DStream *zstd;
+#endif
+    char	in[BUFSIZE];
+}
+DECODER;
+
+/* An input file and its queue of decompressed blocks */
+
+typedef struct
+{
+    const char	*path;
+    char	*blocks;		/* INPUT_QUEUE blocks of BUFSIZE bytes */
+    size_t	lens[INPUT_QUEUE];
+    int		head;			/* first block in the queue */
+    int		count;			/* number of blocks in the queue */
+    int		done;			/* the whole file has been queued */
+    int		error;			/* errno of a failure (or 0) */
+    int		in_use;			/* the first block is being read */
+    off_t	position;		/* offset of that block in the file */
+    off_t	next_position;		/* offset of the block after it */
+    int		busy;			/* a thread is decompressing it */
+    DECODER	*dec;
+    char	last;			/* last character decompressed */
+    const char	*pos;			/* rest of the block being merged */
+    const char	*end;
+    const char	*line;			/* current line when merging */
+    size_t	line_len;
+    time_t	line_time;
+    char	*join;			/* a line that spans two blocks */
+    size_t	join_len;
+    size_t	join_size;
+}
+INPUT_FILE;
+
+
+static INPUT_FILE	*inputs = NULL;
+static int		n_inputs = 0;
+static int		current = 0;		/* file being split */
+static int		window = 0;		/* number of files to read ahead */
+
+#if HAVE_PTHREAD_H
+static pthread_mutex_t	input_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	input_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t	input_threads[INPUT_THREADS];
+static int		n_threads = 0;
+#define LOCK()		pthread_mutex_lock(&input_lock)
+#define UNLOCK()	pthread_mutex_unlock(&input_lock)
+#define WAIT()		pthread_cond_wait(&input_cond, &input_lock)
+#define SIGNAL()	pthread_cond_broadcast(&input_cond)
+#else
+#define LOCK()
+#define UNLOCK()
+#define WAIT()
+#define SIGNAL()
+#endif
+
+
+/* Tell the format of an input file from its first bytes.
+ */
+int
+input_type(const char *data, size_t len)
+{
+    const unsigned char	*magic = (const unsigned char *)data;
+
+    if ((len >= 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b))
+    {
+	return INPUT_GZIP;
+    }
+    if ((len >= 3) && (memcmp(magic, "BZh", 3) == 0))
+    {
+	return INPUT_BZIP2;
+    }
+    if ((len >= 4) && (magic[0] == 0x28) && (magic[1] == 0xb5) && (magic[2] == 0x2f) && (magic[3] == 0xfd))
+    {
+	return INPUT_ZSTD;
+    }
+    return INPUT_PLAIN;
+}
+
+/* Open an input file and start decompressing it according to the
+ * magic number at its start.
+ *
+ * Returns the decoder, or NULL on error (with errno set).
+ */
+static DECODER *
+decoder_open(const char *path)
+{
+    DECODER		*dec;
+    ssize_t		n;
+
+    if ((dec = calloc(1, sizeof (DECODER))) == NULL)
+    {
+	return NULL;
+    }
+    if ((dec->fd = open(path, O_RDONLY)) < 0)
+    {
+	free(dec);
+	return NULL;
+    }
+    while (((n = read(dec->fd, dec->in, sizeof (dec->in))) < 0) && (errno == EINTR))
+    {
+	;
+    }
+    if (n < 0)
+    {
+	close(dec->fd);
+	free(dec);
+	return NULL;
+    }
+    dec->in_len = n;
+    dec->eof    = (n == 0);
+    dec->type   = input_type(dec->in, n);
+
+    switch (dec->type)
+    {
+#if HAVE_ZLIB_H
+    case INPUT_GZIP:
+	inflateInit2(&dec->gz, 15 + 16);
+	break;
+#endif
+#if HAVE_BZLIB_H
+    case INPUT_BZIP2:
+	BZ2_bzDecompressInit(&dec->bz, 0, 0);
+	break;
+#endif
+#if HAVE_ZSTD_H
+    case INPUT_ZSTD:
+	dec->zstd = ZSTD_createDStream();
+	ZSTD_initDStream(dec->zstd);
+	break;
+#endif
+    case INPUT_PLAIN:
+	break;
+
+    default:
+	/* compressed in a format this cronolog was built without */
+
+	close(dec->fd);
+	free(dec);
+	errno = ENOSYS;
+	return NULL;
+    }
+    DEBUG(("Reading \"%s\" (%s)\n", path,
+	   (dec->type == INPUT_GZIP) ? "gzip" : (dec->type == INPUT_BZIP2) ? "bzip2"
+	   : (dec->type == INPUT_ZSTD) ? "zstd" : "plain"));
+    return dec;
+}
+
+/* Decompress as much of the compressed data buffered as will fit in
+ * the output buffer.  A file may hold several compressed streams one
+ * after the other (as made by concatenating compressed files).
+ *
+ * Returns the number of bytes of output, or -1 if the data is corrupt.
+ */
+static int
+decoder_step(DECODER *dec, char *buf, size_t len)
+{
+    size_t	avail = dec->in_len - dec->in_pos;
+    int		rc;
+
+    switch (dec->type)
+    {
+#if HAVE_ZLIB_H
+    case INPUT_GZIP:
+	dec->gz.next_in   = (Bytef *)dec->in + dec->in_pos;
+	dec->gz.avail_in  = avail;
+	dec->gz.next_out  = (Bytef *)buf;
+	dec->gz.avail_out = len;
+	rc = inflate(&dec->gz, Z_NO_FLUSH);
+	dec->in_pos = dec->in_len - dec->gz.avail_in;
+	if (rc == Z_STREAM_END)
+	{
+	    inflateReset(&dec->gz);
+	}
+	else if ((rc != Z_OK) && (rc != Z_BUF_ERROR))
+	{
+	    return -1;
+	}
+	return len - dec->gz.avail_out;
+#endif
+#if HAVE_BZLIB_H
+    case INPUT_BZIP2:
+	dec->bz.next_in   = dec->in + dec->in_pos;
+	dec->bz.avail_in  = avail;
+	dec->bz.next_out  = buf;
+	dec->bz.avail_out = len;
+	rc = BZ2_bzDecompress(&dec->bz);
+	dec->in_pos = dec->in_len - dec->bz.avail_in;
+	if (rc == BZ_STREAM_END)
+	{
+	    BZ2_bzDecompressEnd(&dec->bz);
+	    BZ2_bzDecompressInit(&dec->bz, 0, 0);
+	}
+	else if (rc != BZ_OK)
+	{
+	    return -1;
+	}
+	return len - dec->bz.avail_out;
+#endif
+#if HAVE_ZSTD_H
+    case INPUT_ZSTD:
+	{
+	    ZSTD_inBuffer	zin;
+	    ZSTD_outBuffer	zout;
+
+	    zin.src   = dec->in + dec->in_pos;
+	    zin.size  = avail;
+	    zin.pos   = 0;
+	    zout.dst  = buf;
+	    zout.size = len;
+	    zout.pos  = 0;
+	    if (ZSTD_isError(ZSTD_decompressStream(dec->zstd, &zout, &zin)))
+	    {
+		return -1;
+	    }
+	    dec->in_pos += zin.pos;
+	    return zout.pos;
+	}
+#endif
+    default:
+	if (avail > len)
+	{
+	    avail = len;
+	}
+	memcpy(buf, dec->in + dec->in_pos, avail);
+	dec->in_pos += avail;
+	return avail;
+    }
+}
+
+/* Read up to len bytes of decompressed data from an input file.
+ *
+ * Returns the number of bytes read, 0 at the end of the file or -1 on
+ * error (with errno set).
+ */
+static ssize_t
+decoder_read(DECODER *dec, char *buf, size_t len)
+{
+    size_t	out = 0;
+    ssize_t	n;
+    int		produced;
+
+    while (out < len)
+    {
+	if ((dec->in_pos == dec->in_len) && !dec->eof)
+	{
+	    if ((dec->type == INPUT_PLAIN) && (out == 0))
+	    {
+		/* no need to copy uncompressed data */
+
+		while (((n = read(dec->fd, buf, len)) < 0) && (errno == EINTR))
+		{
+		    ;
+		}
+		dec->eof = (n == 0);
+		return n;
+	    }
+	    while (((n = read(dec->fd, dec->in, sizeof (dec->in))) < 0) && (errno == EINTR))
+	    {
+		;
+	    }
+	    if (n < 0)
+	    {
+		return -1;
+	    }
+	    dec->in_pos = 0;
+	    dec->in_len = n;
+	    dec->eof    = (n == 0);
+	}
+	if ((produced = decoder_step(dec, buf + out, len - out)) < 0)
+	{
+	    errno = EINVAL;
+	    return -1;
+	}
+	out += produced;
+	if (dec->eof && (dec->in_pos == dec->in_len) && (produced == 0))
+	{
+	    break;
+	}
+    }
+    return out;
+}
+
+/* Skip the first offset bytes of the (decompressed) data of an input
+ * file: for an uncompressed file by seeking, otherwise by
+ * decompressing the data into a scratch buffer of BUFSIZE bytes.
+ *
+ * Returns 0 on success or -1 on error (with errno set).
+ */
+static int
+decoder_skip(DECODER *dec, off_t offset, char *scratch)
+{
+    ssize_t	n;
+
+    if (dec->type == INPUT_PLAIN)
+    {
+	if (offset <= (off_t)(dec->in_len - dec->in_pos))
+	{
+	    dec->in_pos += offset;
+	    return 0;
+	}
+	dec->in_pos = dec->in_len;
+	return (lseek(dec->fd, offset, SEEK_SET) < 0) ? -1 : 0;
+    }
+    while (offset > 0)
+    {
+	n = decoder_read(dec, scratch, (offset < BUFSIZE) ? offset : BUFSIZE);
+	if (n <= 0)
+	{
+	    return n;
+	}
+	offset -= n;
+    }
+    return 0;
+}
+
+/* Finish with an input file.
+ */
+static void
+decoder_close(DECODER *dec)
+{
+#if HAVE_ZLIB_H
+    if (dec->type == INPUT_GZIP)
+    {
+	inflateEnd(&dec->gz);
+    }
+#endif
+#if HAVE_BZLIB_H
+    if (dec->type == INPUT_BZIP2)
+    {
+	BZ2_bzDecompressEnd(&dec->bz);
+    }
+#endif
+#if HAVE_ZSTD_H
+    if (dec->type == INPUT_ZSTD)
+    {
+	ZSTD_freeDStream(dec->zstd);
+    }
+#endif
+    close(dec->fd);
+    free(dec);
+}
+
+/* Decompress the next block of an input file into its queue, which
+ * must not be full.  At the end of the file, if it does not end with
+ * a newline one is added, so that its last line is not joined to the
+ * first line of the next file.
+ *
+ * Returns 1 while there is more of the file to decompress, else 0.
+ */
+static int
+input_fill(INPUT_FILE *input)
+{
+    char	*block;
+    ssize_t	n = -1;
+    int		slot;
+
+    if (input->blocks == NULL)
+    {
+	if ((input->blocks = malloc((size_t)INPUT_QUEUE * BUFSIZE)) != NULL)
+	{
+	    input->dec = decoder_open(input->path);
+	}
+	if (   input->dec && input->position
+	    && (decoder_skip(input->dec, input->position, input->blocks) < 0))
+	{
+	    decoder_close(input->dec);
+	    input->dec = NULL;
+	}
+	input->last = '\n';
+    }
+    LOCK();
+    slot = (input->head + input->count) % INPUT_QUEUE;
+    UNLOCK();
+
+    block = input->blocks ? input->blocks + (size_t)slot * BUFSIZE : NULL;
+    if (input->dec && ((n = decoder_read(input->dec, block, BUFSIZE)) > 0))
+    {
+	input->last = block[n - 1];
+	LOCK();
+	input->lens[slot] = n;
+	input->count++;
+	SIGNAL();
+	UNLOCK();
+	return 1;
+    }
+
+    LOCK();
+    if (n < 0)
+    {
+	input->error = errno;
+    }
+    else if (input->last != '\n')
+    {
+	block[0] = '\n';
+	input->lens[slot] = 1;
+	input->count++;
+    }
+    input->done = 1;
+    SIGNAL();
+    UNLOCK();
+    if (input->dec)
+    {
+	decoder_close(input->dec);
+	input->dec = NULL;
+    }
+    return 0;
+}
+
+#if HAVE_PTHREAD_H
+/* Decompression thread: repeatedly decompress a block of the first
+ * file in the window that has room in its queue and that no other
+ * thread is working on, until every file has been decompressed.
+ */
+static void *
+input_thread(void *arg)
+{
+    INPUT_FILE	*input;
+    int		finished;
+    int		i;
+
+    (void)arg;
+    LOCK();
+    for (;;)
+    {
+	input    = NULL;
+	finished = 1;
+	for (i = current; i < n_inputs; i++)
+	{
+	    if (inputs[i].done)
+	    {
+		continue;
+	    }
+	    finished = 0;
+	    if (   (i < current + window) && !inputs[i].busy
+		&& (inputs[i].count < INPUT_QUEUE))
+	    {
+		input = &inputs[i];
+		break;
+	    }
+	}
+	if (finished)
+	{
+	    break;
+	}
+	if (input == NULL)
+	{
+	    WAIT();
+	    continue;
+	}
+	input->busy = 1;
+	UNLOCK();
+	input_fill(input);
+	LOCK();
+	input->busy = 0;
+	SIGNAL();
+    }
+    UNLOCK();
+    return NULL;
+}
+#endif
+
+/* Start reading a list of input files, skipping the first skip bytes
+ * of the first one.  If merge is set the files are to be read side by
+ * side (with input_merge_next()), otherwise one after the other (with
+ * input_next()).
+ *
+ * Returns 0 on success, or -1 on error (with errno set).
+ */
+int
+input_open(char **paths, int n_paths, int merge, off_t skip)
+{
+    int		i;
+
+    if ((inputs = calloc(n_paths, sizeof (INPUT_FILE))) == NULL)
+    {
+	return -1;
+    }
+    for (i = 0; i < n_paths; i++)
+    {
+	inputs[i].path = paths[i];
+    }
+    if (n_paths > 0)
+    {
+	inputs[0].position = inputs[0].next_position = skip;
+    }
+    n_inputs = n_paths;
+    current  = 0;
+    window   = merge ? n_paths : INPUT_THREADS;
+#if HAVE_PTHREAD_H
+    for (n_threads = 0; (n_threads < INPUT_THREADS) && (n_threads < n_paths); n_threads++)
+    {
+	if (pthread_create(&input_threads[n_threads], NULL, input_thread, NULL) != 0)
+	{
+	    break;
+	}
+    }
+    DEBUG(("Decompressing %d input file(s) with %d thread(s)\n", n_paths, n_threads));
+#endif
+    return 0;
+}
+
+/* Return the next block of data from one input file, giving back the
+ * block returned last time.  If the file cannot be read a message is
+ * printed.
+ *
+ * Returns the length of the block, or 0 at the end of the file.
+ */
+static ssize_t
+input_read(int file, const char **pdata)
+{
+    INPUT_FILE	*input = &inputs[file];
+    ssize_t	len;
+
+    LOCK();
+    if (input->in_use)
+    {
+	input->head = (input->head + 1) % INPUT_QUEUE;
+	input->count--;
+	input->in_use = 0;
+	SIGNAL();
+    }
+#if !HAVE_PTHREAD_H
+    if (!input->done && (input->count == 0))
+    {
+	input_fill(input);
+    }
+#endif
+    while ((input->count == 0) && !input->done)
+    {
+	WAIT();
+    }
+    if (input->count > 0)
+    {
+	*pdata = input->blocks + (size_t)input->head * BUFSIZE;
+	len    = input->lens[input->head];
+	input->in_use        = 1;
+	input->position      = input->next_position;
+	input->next_position = input->position + len;
+	UNLOCK();
+	return len;
+    }
+    if (input->error)
+    {
+	fprintf(stderr, "%s: %s\n", input->path, strerror(input->error));
+	input->error = 0;
+    }
+    free(input->blocks);
+    input->blocks = NULL;
+    UNLOCK();
+    return 0;
+}
+
+/* Return the next block of data from the input files, in order.  The
+ * block remains valid until the next call.
+ *
+ * Returns the length of the block, or 0 at the end of the last file.
+ */
+ssize_t
+input_next(const char **pdata)
+{
+    ssize_t	len;
+
+    while (current < n_inputs)
+    {
+	if ((len = input_read(current, pdata)) > 0)
+	{
+	    return len;
+	}
+	LOCK();
+	current++;
+	SIGNAL();
+	UNLOCK();
+    }
+    return 0;
+}
+
+/* Return the number of the file from which the block last returned by
+ * input_next() was read, and the offset of the block in the file.
+ */
+int
+input_position(off_t *poffset)
+{
+    *poffset = inputs[current].position;
+    return current;
+}
+
+/* Move a merged input on to its next line, joining a line that runs
+ * from one block into the next in the input's own buffer.  A line
+ * without a timestamp takes the time of the line before it (or -1).
+ *
+ * Returns 1 if there is a line, or 0 at the end of the input.
+ */
+static int
+merge_advance(int file)
+{
+    INPUT_FILE	*input = &inputs[file];
+    const char	*eol;
+    const char	*data;
+    ssize_t	len;
+    time_t	line_time;
+
+    input->join_len = 0;
+    for (;;)
+    {
+	if (input->pos == input->end)
+	{
+	    if ((len = input_read(file, &data)) == 0)
+	    {
+		return 0;
+	    }
+	    input->pos = data;
+	    input->end = data + len;
+	}
+	eol = memchr(input->pos, '\n', input->end - input->pos);
+	if ((eol != NULL) && (input->join_len == 0))
+	{
+	    input->line     = input->pos;
+	    input->line_len = eol + 1 - input->pos;
+	    input->pos      = eol + 1;
+	    break;
+	}
+	len = (eol ? eol + 1 : input->end) - input->pos;
+	if (input->join_len + len > input->join_size)
+	{
+	    input->join_size = 2 * (input->join_len + len);
+	    if ((input->join = realloc(input->join, input->join_size)) == NULL)
+	    {
+		perror(input->path);
+		exit(1);
+	    }
+	}
+	memcpy(input->join + input->join_len, input->pos, len);
+	input->join_len += len;
+	input->pos      += len;
+	if (eol != NULL)
+	{
+	    input->line     = input->join;
+	    input->line_len = input->join_len;
+	    break;
+	}
+    }
+    if (parse_clf_time(input->line, input->line_len, &line_time) == 0)
+    {
+	input->line_time = line_time;
+    }
+    return 1;
+}
+
+/* Order the inputs in the merge heap by the time of their current
+ * lines, and by their order on the command line for equal times.
+ */
+#define MERGE_BEFORE(a, b)	(   (inputs[a].line_time < inputs[b].line_time) \
+				 || (   (inputs[a].line_time == inputs[b].line_time) \
+				     && ((a) < (b))))
+
+/* Restore the heap order after the time of the input at the top of
+ * the heap has changed.
+ */
+static void
+merge_sift(int *heap, int n, int i)
+{
+    int		child;
+    int		file = heap[i];
+
+    while ((child = 2 * i + 1) < n)
+    {
+	if ((child + 1 < n) && MERGE_BEFORE(heap[child + 1], heap[child]))
+	{
+	    child++;
+	}
+	if (!MERGE_BEFORE(heap[child], file))
+	{
+	    break;
+	}
+	heap[i] = heap[child];
+	i       = child;
+    }
+    heap[i] = file;
+}
+
+/* Return the next line of the input files merged in time order, from
+ * a heap of the inputs keyed on the time of their current lines: as
+ * long as each file is in time order so is the result.  The line
+ * remains valid until the next call.
+ *
+ * Returns the length of the line (including the newline) and its
+ * time (-1 if no line so far in its file had a timestamp), or 0 at
+ * the end of all the files.
+ */
+ssize_t
+input_merge_next(const char **pline, time_t *ptime)
+{
+    static int	*heap = NULL;
+    static int	n_heap = 0;
+    static int	started = 0;
+    int		i;
+
+    if (!started)
+    {
+	if ((heap = calloc(n_inputs, sizeof (int))) == NULL)
+	{
+	    perror("input");
+	    exit(1);
+	}
+	for (i = 0; i < n_inputs; i++)
+	{
+	    inputs[i].line_time = -1;
+	    if (merge_advance(i))
+	    {
+		heap[n_heap++] = i;
+	    }
+	}
+	for (i = n_heap / 2 - 1; i >= 0; i--)
+	{
+	    merge_sift(heap, n_heap, i);
+	}
+	started = 1;
+    }
+    else if (n_heap > 0)
+    {
+	/* Move on from the line returned last time */
+
+	if (!merge_advance(heap[0]))
+	{
+	    heap[0] = heap[--n_heap];
+	}
+	merge_sift(heap, n_heap, 0);
+    }
+    if (n_heap == 0)
+    {
+	free(heap);
+	heap    = NULL;
+	started = 0;
+	return 0;
+    }
+    *pline = inputs[heap[0]].line;
+    *ptime = inputs[heap[0]].line_time;
+    return inputs[heap[0]].line_len;
+}
+
+/* Finish reading the input files.
+ */
+void
+input_close(void)
+{
+    int		i;
+
+#if HAVE_PTHREAD_H
+    LOCK();
+    current = n_inputs;
+    SIGNAL();
+    UNLOCK();
+    for (i = 0; i < n_threads; i++)
+    {
+	pthread_join(input_threads[i], NULL);
+    }
+    n_threads = 0;
+#endif
+    for (i = 0; i < n_inputs; i++)
+    {
+	if (inputs[i].dec)
+	{
+	    decoder_close(inputs[i].dec);
+	}
+	free(inputs[i].blocks);
+	free(inputs[i].join);
+    }
+    free(inputs);
+    inputs   = NULL;
+    n_inputs = 0;
+}
@@ -0,0 +1,484 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronojournal -- write-ahead journal for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * cronolog holds some of the data it has read in memory before it
+ * reaches the log files: incomplete lines of sharded templates,
+ * unfinished gzip frames and data held back in degraded mode.  If a
+ * journal file is given, every block read is first appended to a
+ * ring buffer in the journal, which is mapped into memory, together
+ * with the time at which it was read.
+ *
+ * The journal also holds a mark for each output: the position in the
+ * input of the oldest data that the output has not yet safely
+ * written, and for a compressed output with an unfinished frame, the
+ * log file and the offset at which the frame starts.  Records before
+ * the oldest mark are discarded.  When cronolog starts, the records
+ * after the marks are written out again to the log files of the
+ * periods in which they were read (see replay_journal() in
+ * cronolog.c).
+ *
+ * The journal is written through a shared mapping, so it survives
+ * cronolog being killed or crashing without any system calls on the
+ * write path; it only survives a system crash if the kernel has
+ * written the pages back.  Each record carries a CRC-32C so that a
+ * torn record is not replayed.
+ *
+ * Positions in the input are counted from the creation of the
+ * journal; the offset of a position in the ring is the position
+ * modulo the size of the ring.  The marks are kept by output number,
+ * so the journal must be used with the same templates each time.
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+
+
+#define JOURNAL_MAGIC	"CRONOJ2"
+
+typedef struct
+{
+    off_t	pos;			/* oldest input not safely written */
+    off_t	frame_offset;		/* start of an unfinished frame... */
+    char	filename[MAX_PATH];	/* ...in this log file (or "") */
+}
+JOURNAL_MARK;
+
+typedef struct
+{
+    char	magic[8];
+    off_t	size;			/* size of the ring */
+    off_t	head;			/* position after the last record */
+    off_t	tail;			/* position of the first record kept */
+    int		n_marks;
+    JOURNAL_MARK marks[JOURNAL_OUTPUTS];
+}
+JOURNAL_HEADER;
+
+typedef struct
+{
+    long		time;	/* time at which the data was read */
+    unsigned long	len;	/* length of the data */
+    unsigned long	crc;	/* CRC-32C of the data */
+}
+JOURNAL_RECORD;
+
+
+static const char	*journal_name = NULL;
+static JOURNAL_HEADER	*journal = NULL;
+static char		*ring;
+static off_t		cursor;		/* position of the next record to replay */
+
+
+/* Copy data into the ring at a position, wrapping around at the end.
+ */
+static void
+ring_put(off_t pos, const void *src, size_t len)
+{
+    off_t	offset = pos % journal->size;
+    size_t	first  = journal->size - offset;
+
+    if (first > len)
+    {
+	first = len;
+    }
+    memcpy(ring + offset, src, first);
+    memcpy(ring, (const char *)src + first, len - first);
+}
+
+/* Copy data out of the ring from a position, wrapping around at the end.
+ */
+static void
+ring_get(off_t pos, void *dst, size_t len)
+{
+    off_t	offset = pos % journal->size;
+    size_t	first  = journal->size - offset;
+
+    if (first > len)
+    {
+	first = len;
+    }
+    memcpy(dst, ring + offset, first);
+    memcpy((char *)dst + first, ring, len - first);
+}
+
+/* Set all the marks to the head of the journal, discarding all the
+ * records.
+ */
+void
+journal_reset(void)
+{
+    int		i;
+
+    if (journal == NULL)
+    {
+	return;
+    }
+    for (i = 0; i < journal->n_marks; i++)
+    {
+	journal_mark(i, journal->head, NULL, 0);
+    }
+    journal->tail = cursor = journal->head;
+}
+
+/* Open (or create) the journal file for a number of outputs and map it
+ * into memory.  A new journal has a ring of JOURNAL_SIZE bytes.
+ */
+int
+journal_open(const char *path, int n_outputs)
+{
+    struct stat	stat_buf;
+    off_t	file_size;
+    void	*map;
+    int		fd;
+    int		i;
+
+    if (n_outputs > JOURNAL_OUTPUTS)
+    {
+	fprintf(stderr, "%s: a journal can only be used with up to %d log files\n",
+		path, JOURNAL_OUTPUTS);
+	return -1;
+    }
+    if ((fd = open(path, O_RDWR|O_CREAT, FILE_MODE)) < 0)
+    {
+	perror(path);
+	return -1;
+    }
+    if (fstat(fd, &stat_buf) < 0)
+    {
+	perror(path);
+	close(fd);
+	return -1;
+    }
+    file_size = stat_buf.st_size;
+    if (file_size == 0)
+    {
+	file_size = sizeof (JOURNAL_HEADER) + JOURNAL_SIZE;
+	if (ftruncate(fd, file_size) < 0)
+	{
+	    perror(path);
+	    close(fd);
+	    return -1;
+	}
+    }
+    map = mmap(NULL, file_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+	perror(path);
+	return -1;
+    }
+    journal      = (JOURNAL_HEADER *)map;
+    ring         = (char *)map + sizeof (JOURNAL_HEADER);
+    journal_name = path;
+
+    if (stat_buf.st_size == 0)
+    {
+	memcpy(journal->magic, JOURNAL_MAGIC, sizeof (journal->magic));
+	journal->size    = file_size - sizeof (JOURNAL_HEADER);
+	journal->head    = journal->tail = 0;
+	journal->n_marks = n_outputs;
+	journal_reset();
+    }
+    else if (   (memcmp(journal->magic, JOURNAL_MAGIC, sizeof (journal->magic)) != 0)
+	     || (journal->size != file_size - (off_t)sizeof (JOURNAL_HEADER))
+	     || (journal->tail < 0) || (journal->head < journal->tail)
+	     || (journal->head - journal->tail > journal->size))
+    {
+	fprintf(stderr, "%s: not a cronolog journal\n", path);
+	munmap(map, file_size);
+	journal = NULL;
+	return -1;
+    }
+    else if (journal->n_marks != n_outputs)
+    {
+	/* The templates have changed: give every output all the
+	 * records kept */
+
+	if (journal->head > journal->tail)
+	{
+	    fprintf(stderr, "%s: journal was written for %d log files, not %d\n",
+		    path, journal->n_marks, n_outputs);
+	}
+	for (i = 0; i < n_outputs; i++)
+	{
+	    journal->marks[i].pos         = journal->tail;
+	    journal->marks[i].filename[0] = '\0';
+	}
+	journal->n_marks = n_outputs;
+    }
+    cursor = journal->tail;
+    DEBUG(("Journal \"%s\" holds %ld bytes\n", path,
+	   (long)(journal->head - journal->tail)));
+    return 0;
+}
+
+/* Return the position in the input after the last record.
+ */
+off_t
+journal_position(void)
+{
+    return journal ? journal->head : 0;
+}
+
+/* Return the mark of an output, and the log file and offset of its
+ * unfinished frame if it has one (otherwise *pfilename is set to NULL).
+ */
+off_t
+journal_get_mark(int output, const char **pfilename, off_t *poffset)
+{
+    JOURNAL_MARK	*mark = &journal->marks[output];
+
+    *pfilename = mark->filename[0] ? mark->filename : NULL;
+    *poffset   = mark->frame_offset;
+    return mark->pos;
+}
+
+/* Set the mark of an output: all input before pos has been safely
+ * written, and if filename is given, so has the log file up to
+ * offset, where an unfinished frame starts.
+ */
+void
+journal_mark(int output, off_t pos, const char *filename, off_t offset)
+{
+    JOURNAL_MARK	*mark;
+
+    if (journal == NULL)
+    {
+	return;
+    }
+    mark = &journal->marks[output];
+    mark->pos          = pos;
+    mark->frame_offset = offset;
+    if (filename)
+    {
+	snprintf(mark->filename, sizeof (mark->filename), "%s", filename);
+    }
+    else
+    {
+	mark->filename[0] = '\0';
+    }
+}
+
+/* Start reading the records of the journal from the first one kept.
+ */
+void
+journal_rewind(void)
+{
+    if (journal)
+    {
+	cursor = journal->tail;
+    }
+}
+
+/* Return the next record of the journal, copying its data into buf.
+ * Returns the length of the data, or 0 if there are no more records
+ * (or the rest of the journal is corrupt), and sets the time at which
+ * the data was read and its position in the input.
+ */
+int
+journal_next(char *buf, size_t buflen, time_t *ptime, off_t *ppos)
+{
+    JOURNAL_RECORD	rec;
+
+    if ((journal == NULL) || (cursor >= journal->head))
+    {
+	return 0;
+    }
+    ring_get(cursor, &rec, sizeof (rec));
+    if (   (rec.len == 0) || (rec.len > buflen)
+	|| (cursor + (off_t)(sizeof (rec) + rec.len) > journal->head))
+    {
+	fprintf(stderr, "%s: corrupt record in journal\n", journal_name);
+	return 0;
+    }
+    ring_get(cursor + sizeof (rec), buf, rec.len);
+    if (crc32c(0, buf, rec.len) != rec.crc)
+    {
+	fprintf(stderr, "%s: corrupt record in journal\n", journal_name);
+	return 0;
+    }
+    *ptime = rec.time;
+    *ppos  = cursor + sizeof (rec);
+    cursor = *ppos + rec.len;
+    return rec.len;
+}
+
+/* Discard the records before the oldest mark.
+ */
+void
+journal_commit(void)
+{
+    JOURNAL_RECORD	rec;
+    off_t		oldest;
+    int			i;
+
+    if (journal == NULL)
+    {
+	return;
+    }
+    oldest = journal->head;
+    for (i = 0; i < journal->n_marks; i++)
+    {
+	if (journal->marks[i].pos < oldest)
+	{
+	    oldest = journal->marks[i].pos;
+	}
+    }
+    while (journal->tail < journal->head)
+    {
+	ring_get(journal->tail, &rec, sizeof (rec));
+	if (journal->tail + (off_t)(sizeof (rec) + rec.len) > oldest)
+	{
+	    break;
+	}
+	journal->tail += sizeof (rec) + rec.len;
+    }
+}
+
+/* Append a block of data read at a given time to the journal.
+ * Returns -1 if there is not enough room in the ring.
+ */
+int
+journal_append(const char *buf, size_t len, time_t time_now)
+{
+    JOURNAL_RECORD	rec;
+    off_t		need = sizeof (rec) + len;
+
+    if (journal == NULL)
+    {
+	return 0;
+    }
+    if (journal->head - journal->tail + need > journal->size)
+    {
+	return -1;
+    }
+    rec.time = time_now;
+    rec.len  = len;
+    rec.crc  = crc32c(0, buf, len);
+    ring_put(journal->head, &rec, sizeof (rec));
+    ring_put(journal->head + sizeof (rec), buf, len);
+    journal->head += need;
+    return 0;
+}
+
+#else /* !HAVE_SYS_MMAN_H */
+
+int
+journal_open(const char *path, int n_outputs)
+{
+    fprintf(stderr, "%s: compiled without support for a journal\n", path);
+    return -1;
+}
+
+off_t
+journal_position(void)
+{
+    return 0;
+}
+
+off_t
+journal_get_mark(int output, const char **pfilename, off_t *poffset)
+{
+    *pfilename = NULL;
+    return 0;
+}
+
+void
+journal_mark(int output, off_t pos, const char *filename, off_t offset)
+{
+}
+
+void
+journal_rewind(void)
+{
+}
+
+int
+journal_next(char *buf, size_t buflen, time_t *ptime, off_t *ppos)
+{
+    return 0;
+}
+
+void
+journal_commit(void)
+{
+}
+
+void
+journal_reset(void)
+{
+}
+
+int
+journal_append(const char *buf, size_t len, time_t time_now)
+{
+    return 0;
+}
+
+#endif
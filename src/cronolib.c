@@ -0,0 +1,324 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronolib -- writer library for embedding cronolog in other programs
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * The functions declared in cronolog.h wrap an output (a template
+ * with its period and current log file, as used by cronolog itself)
+ * in a handle, so that a server can write its own rotated logs with
+ * the same file naming, subdirectory creation and links as cronolog.
+ *
+ * Each handle has a mutex, held while a log file is rotated and
+ * written to, so that a handle can be used by several threads.  Log
+ * files are only opened with a second, global, mutex held as well,
+ * because create_subdirs() remembers the last directory it created.
+ */
+
+#include "cronoutils.h"
+#include "cronolog.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+
+struct cronolog
+{
+    LOG_OUTPUT		output;
+#if HAVE_PTHREAD_H
+    pthread_mutex_t	lock;
+#endif
+};
+
+#if HAVE_PTHREAD_H
+static pthread_mutex_t	open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define LOCK(log)	pthread_mutex_lock(&(log)->lock)
+#define UNLOCK(log)	pthread_mutex_unlock(&(log)->lock)
+#define LOCK_OPEN()	pthread_mutex_lock(&open_lock)
+#define UNLOCK_OPEN()	pthread_mutex_unlock(&open_lock)
+#else
+#define LOCK(log)
+#define UNLOCK(log)
+#define LOCK_OPEN()
+#define UNLOCK_OPEN()
+#endif
+
+
+/* Free a handle and the strings copied into it.
+ */
+static void
+free_handle(CRONOLOG *log)
+{
+    free(log->output.template);
+    free(log->output.linkname);
+    free(log->output.prevlinkname);
+    free(log);
+}
+
+/* Copy an optional string into a handle.
+ *
+ * Returns 0 on success or -1 if there is no memory.
+ */
+static int
+copy_option(char **pdest, const char *src)
+{
+    *pdest = NULL;
+    if (src && ((*pdest = strdup(src)) == NULL))
+    {
+	return -1;
+    }
+    return 0;
+}
+
+/* Open a log file template with options as for the cronolog command.
+ * No log file is opened until the first write.
+ *
+ * Returns a handle, or NULL on error (with errno set: EINVAL if the
+ * options are not valid).
+ */
+CRONOLOG *
+cronolog_open(const char *template, const CRONOLOG_OPTIONS *opts)
+{
+    CRONOLOG_OPTIONS	defaults = CRONOLOG_DEFAULT_OPTIONS;
+    LOG_OUTPUT		*output;
+    CRONOLOG		*log;
+    PERIODICITY		delay_units = UNKNOWN;
+    int			delay = 0;
+
+    if (template == NULL)
+    {
+	errno = EINVAL;
+	return NULL;
+    }
+    if (opts == NULL)
+    {
+	opts = &defaults;
+    }
+    if ((log = calloc(1, sizeof (*log))) == NULL)
+    {
+	return NULL;
+    }
+    output = &log->output;
+    init_output(output);
+    output->max_size = opts->size_limit;
+    output->linktype = opts->hardlink ? S_IFREG : S_IFLNK;
+
+    if (   (copy_option(&output->template, template) < 0)
+	|| (copy_option(&output->linkname, opts->hardlink ? opts->hardlink : opts->symlink) < 0)
+	|| (copy_option(&output->prevlinkname, opts->prev_symlink) < 0))
+    {
+	free_handle(log);
+	errno = ENOMEM;
+	return NULL;
+    }
+
+    /* Check the options as the cronolog command does */
+
+    if (opts->period)
+    {
+	output->periodicity = parse_timespec((char *)opts->period, &output->period_multiple);
+	if (!valid_period(output->periodicity, output->period_multiple))
+	{
+	    free_handle(log);
+	    errno = EINVAL;
+	    return NULL;
+	}
+    }
+    else
+    {
+	output->periodicity = determine_periodicity(output->template);
+    }
+    if (opts->delay)
+    {
+	delay_units = parse_timespec((char *)opts->delay, &delay);
+    }
+    if (   (output->max_size < 0)
+	|| (output->max_size && !template_has_specifier(output->template, "N"))
+	|| (delay_units == INVALID_PERIOD)
+	|| (   delay
+	    && (   (delay_units > output->periodicity)
+		|| ((delay_units == output->periodicity) && (abs(delay) >= output->period_multiple)))))
+    {
+	free_handle(log);
+	errno = EINVAL;
+	return NULL;
+    }
+    if (delay)
+    {
+	output->period_delay_units = delay_units;
+	output->period_delay       = delay * period_seconds[delay_units];
+    }
+
+#if HAVE_PTHREAD_H
+    pthread_mutex_init(&log->lock, NULL);
+#endif
+    if (opts->coordinate)
+    {
+	shared_attach(output);
+    }
+    DEBUG(("Opened \"%s\", rotated per %d %s\n", output->template,
+	   output->period_multiple, periods[output->periodicity]));
+    return log;
+}
+
+/* Write an I/O vector to the current log file of a template, opening
+ * a new log file first if the period of the current one has finished
+ * or it would go past its size limit.
+ *
+ * Returns the number of bytes written, or -1 on error (with errno
+ * set).
+ */
+ssize_t
+cronolog_writev(CRONOLOG *log, const struct iovec *iov, int iovcnt)
+{
+    LOG_OUTPUT	*output = &log->output;
+    time_t	time_now = time(NULL);
+    size_t	len;
+    ssize_t	n;
+    int		log_fd;
+    int		i;
+
+    for (len = 0, i = 0; i < iovcnt; i++)
+    {
+	len += iov[i].iov_len;
+    }
+
+    LOCK(log);
+    if (   (output->writer.fd >= 0) && output->max_size && (output->writer.length > 0)
+	&& (output->writer.length + (off_t)len > output->max_size))
+    {
+	output->size_reached = 1;
+    }
+    if (   (output->writer.fd >= 0)
+	&& ((time_now >= output->next_period) || output->size_reached))
+    {
+	log_writer_close(&output->writer);
+    }
+    if (output->writer.fd < 0)
+    {
+	LOCK_OPEN();
+	log_fd = new_log_file(output, time_now);
+	UNLOCK_OPEN();
+	if (   (log_fd < 0)
+	    || (log_writer_open(&output->writer, log_fd, 0, 0, 0) < 0))
+	{
+	    if (log_fd >= 0)
+	    {
+		close(log_fd);
+	    }
+	    output->writer.fd = -1;
+	    UNLOCK(log);
+	    return -1;
+	}
+    }
+    n = log_writer_writev(&output->writer, iov, iovcnt);
+    UNLOCK(log);
+    return n;
+}
+
+/* Write a buffer to the current log file of a template (see
+ * cronolog_writev()).
+ */
+ssize_t
+cronolog_write(CRONOLOG *log, const char *buf, size_t len)
+{
+    struct iovec	iov;
+
+    iov.iov_base = (char *)buf;
+    iov.iov_len  = len;
+    return cronolog_writev(log, &iov, 1);
+}
+
+/* Copy the name of the current log file of a template.
+ */
+void
+cronolog_filename(CRONOLOG *log, char *buf, size_t buflen)
+{
+    if (buflen == 0)
+    {
+	return;
+    }
+    LOCK(log);
+    snprintf(buf, buflen, "%s", (log->output.writer.fd >= 0) ? log->output.filename : "");
+    UNLOCK(log);
+}
+
+/* Close the current log file of a template and free the handle.
+ */
+void
+cronolog_close(CRONOLOG *log)
+{
+    if (log == NULL)
+    {
+	return;
+    }
+    log_writer_close(&log->output.writer);
+    shared_detach(&log->output);
+#if HAVE_PTHREAD_H
+    pthread_mutex_destroy(&log->lock);
+#endif
+    free_handle(log);
+}
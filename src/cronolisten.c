@@ -0,0 +1,550 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronolisten -- Unix domain socket listener for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * With the options "-u path" and "-U path" cronolog listens on Unix
+ * domain stream and datagram sockets "path" and logs whatever the
+ * programs that connect to them send, alongside its standard input,
+ * so that many short-lived processes can log through one cronolog
+ * without a pipe or a cronolog process each.
+ *
+ * A connection or a datagram that starts with "@tag" followed by a
+ * space or a newline goes to the template given the option "-A tag",
+ * the prefix being removed; anything else (and anything with a tag
+ * that no template has) goes to the templates without a tag.  The
+ * tag of a stream is taken from its start, so a client gives it once
+ * as a handshake line ("@tag\n") before its log lines.
+ *
+ * The listening sockets and the connections are watched with one
+ * epoll descriptor, which cronolog polls along with its standard
+ * input.  When it is readable listen_read() takes the events that
+ * are ready, with no waiting:
+ *
+ *  - each new connection is accepted;
+ *
+ *  - the datagram socket is read LISTEN_BATCH datagrams at a time
+ *    with recvmmsg(), and runs of datagrams with the same tag are
+ *    copied into the caller's buffer as lines;
+ *
+ *  - each connection is read once into its own buffer, from which
+ *    whole lines are passed on, so that lines from different
+ *    connections are never mixed (a line that fills the buffer or is
+ *    left when the client closes the connection is ended with a
+ *    newline).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1		/* for recvmmsg() */
+#endif
+
+#include "cronoutils.h"
+
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_UN_H
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+
+typedef struct
+{
+    int		fd;
+    int		started;		/* the tag (if any) has been read */
+    int		closed;			/* the client has closed the connection */
+    char	tag[LISTEN_TAG_MAX + 1];	/* tag of the stream ("" if none) */
+    size_t	len;
+    char	buf[BUFSIZE - 1];	/* data not yet passed on */
+}
+CONNECTION;
+
+static int		epoll_fd  = -1;
+static int		stream_fd = -1;
+static int		dgram_fd  = -1;
+static const char	*stream_path = NULL;
+static const char	*dgram_path  = NULL;
+static int		accept_paused = 0;	/* out of descriptors */
+
+/* Events taken by the last epoll_wait() call, not all handled yet */
+
+static struct epoll_event events[LISTEN_EVENTS];
+static int		n_events   = 0;
+static int		next_event = 0;
+static int		polled     = 0;
+
+/* Datagrams taken by the last recvmmsg() call, not all passed on yet */
+
+static char		dgram_buf[LISTEN_BATCH][LISTEN_DGRAM_SIZE];
+static size_t		dgram_len[LISTEN_BATCH];
+static int		n_dgrams   = 0;
+static int		next_dgram = 0;
+#if HAVE_RECVMMSG
+static struct mmsghdr	dgram_msgs[LISTEN_BATCH];
+static struct iovec	dgram_iov[LISTEN_BATCH];
+#endif
+
+/* Tag of the data last passed on */
+
+static char		tag_buf[LISTEN_TAG_MAX + 1];
+
+
+/* Add a descriptor to the epoll set, to be reported with data.
+ */
+static int
+watch(int fd, void *data)
+{
+    struct epoll_event	event;
+
+    memset(&event, 0, sizeof (event));
+    event.events   = EPOLLIN;
+    event.data.ptr = data;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/* Listen on a socket of the given type bound to path and watch it.
+ *
+ * Returns the socket, or -1 on error (with errno set).
+ */
+static int
+listen_socket(const char *path, int type, void *data)
+{
+    int		fd;
+    int		err;
+
+    if ((fd = socket_listen(path, type)) < 0)
+    {
+	return -1;
+    }
+    if (watch(fd, data) < 0)
+    {
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+    }
+    return fd;
+}
+
+/* Listen on a stream socket and a datagram socket (either path may be
+ * NULL).
+ *
+ * Returns a descriptor that is readable when there is something for
+ * listen_read() to do, or -1 on error (with errno set).
+ */
+int
+listen_open(const char *stream, const char *dgram)
+{
+#if HAVE_RECVMMSG
+    int		i;
+#endif
+
+    if ((epoll_fd = epoll_create(LISTEN_EVENTS)) < 0)
+    {
+	return -1;
+    }
+    if (stream && ((stream_fd = listen_socket(stream, SOCK_STREAM, &stream_fd)) < 0))
+    {
+	return -1;
+    }
+    stream_path = stream;
+    if (dgram && ((dgram_fd = listen_socket(dgram, SOCK_DGRAM, &dgram_fd)) < 0))
+    {
+	return -1;
+    }
+    dgram_path = dgram;
+#if HAVE_RECVMMSG
+    for (i = 0; i < LISTEN_BATCH; i++)
+    {
+	dgram_iov[i].iov_base = dgram_buf[i];
+	dgram_iov[i].iov_len  = LISTEN_DGRAM_SIZE;
+	dgram_msgs[i].msg_hdr.msg_iov    = &dgram_iov[i];
+	dgram_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+    DEBUG(("Listening on \"%s\" (stream) and \"%s\" (datagram)\n",
+	   stream ? stream : "", dgram ? dgram : ""));
+    return epoll_fd;
+}
+
+/* Accept the pending connections.  If cronolog runs out of
+ * descriptors the stream socket is not watched until a connection is
+ * closed (rather than being reported as ready again and again).
+ */
+static void
+accept_connections(void)
+{
+    CONNECTION	*conn;
+    int		fd;
+
+    while ((fd = accept(stream_fd, NULL, NULL)) >= 0)
+    {
+	conn = malloc(sizeof (CONNECTION));
+	if (   (conn == NULL) || (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)
+	    || (watch(fd, conn) < 0))
+	{
+	    close(fd);
+	    free(conn);
+	    continue;
+	}
+	conn->fd      = fd;
+	conn->started = 0;
+	conn->closed  = 0;
+	conn->tag[0]  = '\0';
+	conn->len     = 0;
+	DEBUG(("Accepted connection %d\n", fd));
+    }
+    if ((errno == EMFILE) || (errno == ENFILE))
+    {
+	DEBUG(("Out of descriptors: not accepting connections\n"));
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, stream_fd, NULL);
+	accept_paused = 1;
+    }
+}
+
+/* Close a connection once all its data has been passed on.
+ */
+static void
+close_connection(CONNECTION *conn)
+{
+    DEBUG(("Closed connection %d\n", conn->fd));
+    close(conn->fd);
+    free(conn);
+    if (accept_paused && (watch(stream_fd, &stream_fd) == 0))
+    {
+	accept_paused = 0;
+    }
+}
+
+/* Read the tag prefix ("@tag" and a space or a newline) at the start
+ * of len bytes of data into tag ("" if there is none).  complete is
+ * set if no more data can follow.
+ *
+ * Returns the length of the prefix (0 if there is none), or -1 if
+ * more data is needed to tell.
+ */
+static int
+parse_tag(const char *data, size_t len, int complete, char *tag)
+{
+    size_t	n;
+
+    tag[0] = '\0';
+    if (len == 0)
+    {
+	return complete ? 0 : -1;
+    }
+    if (data[0] != '@')
+    {
+	return 0;
+    }
+    for (n = 1; (n < len) && (n <= LISTEN_TAG_MAX + 1); n++)
+    {
+	if ((data[n] == ' ') || (data[n] == '\n'))
+	{
+	    if (n == 1)
+	    {
+		return 0;
+	    }
+	    memcpy(tag, data + 1, n - 1);
+	    tag[n - 1] = '\0';
+	    return n + 1;
+	}
+    }
+    return ((n > LISTEN_TAG_MAX + 1) || complete) ? 0 : -1;
+}
+
+/* Read the datagrams waiting on the datagram socket, up to
+ * LISTEN_BATCH of them (with a single call if recvmmsg() is
+ * available).
+ */
+static void
+receive_datagrams(void)
+{
+#if HAVE_RECVMMSG
+    int		n;
+
+    n = recvmmsg(dgram_fd, dgram_msgs, LISTEN_BATCH, MSG_DONTWAIT, NULL);
+    for (n_dgrams = 0; n_dgrams < n; n_dgrams++)
+    {
+	dgram_len[n_dgrams] = dgram_msgs[n_dgrams].msg_len;
+    }
+#else
+    ssize_t	len;
+    int		n;
+
+    for (n = 0; n < LISTEN_BATCH; n++)
+    {
+	if ((len = recv(dgram_fd, dgram_buf[n], LISTEN_DGRAM_SIZE, MSG_DONTWAIT)) < 0)
+	{
+	    break;
+	}
+	dgram_len[n] = len;
+    }
+    n_dgrams = n;
+#endif
+    next_dgram = 0;
+}
+
+/* Copy a run of datagrams with the same tag into buf as lines.
+ *
+ * Returns the number of bytes copied (0 if the datagrams were empty).
+ */
+static ssize_t
+take_datagrams(char *buf, size_t buflen, const char **ptag)
+{
+    char	tag[LISTEN_TAG_MAX + 1];
+    const char	*data;
+    size_t	used = 0;
+    size_t	len;
+    int		skip;
+
+    while (next_dgram < n_dgrams)
+    {
+	data = dgram_buf[next_dgram];
+	len  = dgram_len[next_dgram];
+	skip = parse_tag(data, len, 1, tag);
+	if (used > 0)
+	{
+	    if ((strcmp(tag, tag_buf) != 0) || (used + len - skip + 1 > buflen))
+	    {
+		break;
+	    }
+	}
+	else
+	{
+	    strcpy(tag_buf, tag);
+	}
+	next_dgram++;
+	if (len > (size_t)skip)
+	{
+	    memcpy(buf + used, data + skip, len - skip);
+	    used += len - skip;
+	    if (buf[used - 1] != '\n')
+	    {
+		buf[used++] = '\n';
+	    }
+	}
+    }
+    *ptag = tag_buf[0] ? tag_buf : NULL;
+    return used;
+}
+
+/* Read what a client has sent on a connection and copy the whole
+ * lines of it into buf (all of it if the buffer is full or the client
+ * has closed the connection).
+ *
+ * Returns the number of bytes copied.
+ */
+static ssize_t
+read_connection(CONNECTION *conn, char *buf, const char **ptag)
+{
+    ssize_t	n;
+    int		skip;
+
+    n = read(conn->fd, conn->buf + conn->len, sizeof (conn->buf) - conn->len);
+    if (n > 0)
+    {
+	conn->len += n;
+    }
+    else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+    {
+	conn->closed = 1;
+    }
+    if (!conn->started)
+    {
+	skip = parse_tag(conn->buf, conn->len,
+			 conn->closed || (conn->len == sizeof (conn->buf)), conn->tag);
+	if (skip < 0)
+	{
+	    return 0;
+	}
+	conn->len -= skip;
+	memmove(conn->buf, conn->buf + skip, conn->len);
+	conn->started = 1;
+    }
+    if (conn->closed || (conn->len == sizeof (conn->buf)))
+    {
+	n = conn->len;
+    }
+    else
+    {
+	for (n = conn->len; (n > 0) && (conn->buf[n - 1] != '\n'); n--)
+	{
+	}
+    }
+    memcpy(buf, conn->buf, n);
+    conn->len -= n;
+    memmove(conn->buf, conn->buf + n, conn->len);
+    if ((n > 0) && (buf[n - 1] != '\n'))
+    {
+	buf[n++] = '\n';
+    }
+    strcpy(tag_buf, conn->tag);
+    *ptag = tag_buf[0] ? tag_buf : NULL;
+    return n;
+}
+
+/* Handle the events that are ready on the sockets, without waiting,
+ * and copy the next lines received into buf (of at least BUFSIZE
+ * bytes), setting *ptag to their tag (NULL if none).  Lines with
+ * different tags are returned by different calls.
+ *
+ * Returns the number of bytes copied, or 0 once the events ready
+ * when the sockets were last polled have all been handled.
+ */
+ssize_t
+listen_read(char *buf, size_t buflen, const char **ptag)
+{
+    CONNECTION	*conn;
+    void	*data;
+    ssize_t	n;
+
+    for (;;)
+    {
+	if (next_dgram < n_dgrams)
+	{
+	    if ((n = take_datagrams(buf, buflen, ptag)) > 0)
+	    {
+		return n;
+	    }
+	    continue;
+	}
+	if (next_event >= n_events)
+	{
+	    if (polled)
+	    {
+		polled = 0;
+		return 0;
+	    }
+	    n_events   = epoll_wait(epoll_fd, events, LISTEN_EVENTS, 0);
+	    next_event = 0;
+	    if (n_events <= 0)
+	    {
+		n_events = 0;
+		return 0;
+	    }
+	    polled = 1;
+	}
+	data = events[next_event++].data.ptr;
+	if (data == &stream_fd)
+	{
+	    accept_connections();
+	}
+	else if (data == &dgram_fd)
+	{
+	    receive_datagrams();
+	}
+	else
+	{
+	    conn = data;
+	    n = read_connection(conn, buf, ptag);
+	    if (conn->closed && (conn->len == 0))
+	    {
+		close_connection(conn);
+	    }
+	    if (n > 0)
+	    {
+		return n;
+	    }
+	}
+    }
+}
+
+/* Stop listening, removing the sockets.
+ */
+void
+listen_close(void)
+{
+    if (stream_fd >= 0)
+    {
+	close(stream_fd);
+	unlink(stream_path);
+    }
+    if (dgram_fd >= 0)
+    {
+	close(dgram_fd);
+	unlink(dgram_path);
+    }
+    stream_fd = dgram_fd = -1;
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+
+int
+listen_open(const char *stream, const char *dgram)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+ssize_t
+listen_read(char *buf, size_t buflen, const char **ptag)
+{
+    return 0;
+}
+
+void
+listen_close(void)
+{
+}
+
+#endif
@@ -0,0 +1,179 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronolog-attach -- hand a piped log over to a cronolog daemon
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * cronolog-attach is run by Apache in place of cronolog, with the same
+ * arguments:
+ *
+ *	TransferLog "|/www/etc/cronolog-attach /www/logs/%Y/%m/%d/access.log"
+ *
+ * It passes the pipe it was given as its standard input, with its
+ * arguments, to a cronolog started as a daemon with "cronolog -D path"
+ * (see cronoattach.c), which then reads the pipe and writes the log
+ * files, so that one cronolog serves all the piped logs of the server
+ * instead of one cronolog with its own buffers for each.
+ *
+ * cronolog-attach exits as soon as the daemon has taken the pipe, as
+ * the server only needs to keep the write end of the pipe open, so no
+ * process is left per log.  With the option "--wait" it waits instead,
+ * using no buffers, until the daemon has read the pipe to the end (or
+ * has died), for servers that start a new piped log program whenever
+ * the one they started exits.  If no daemon is listening, or the
+ * daemon refuses the arguments, it runs cronolog itself (from the same
+ * directory), so that the log is written all the same.
+ *
+ * Usage:
+ *
+ *	cronolog-attach [--socket=path] [--wait] [cronolog options] template ...
+ */
+
+#include "cronoutils.h"
+
+
+#define USAGE_MSG 	"usage: %s [--socket=PATH] [--wait] [OPTIONS] logfile-spec ...\n"
+
+
+/* Run cronolog with the same arguments, from the directory of this
+ * program if it was run with a path.
+ */
+static void
+run_cronolog(char *prog, char **args)
+{
+    char	path[MAX_PATH];
+    char	*slash = strrchr(prog, '/');
+
+    args[-1] = "cronolog";
+    if (slash && (slash - prog + sizeof ("/cronolog") <= sizeof (path)))
+    {
+	memcpy(path, prog, slash - prog);
+	strcpy(path + (slash - prog), "/cronolog");
+	execv(path, args - 1);
+    }
+    else
+    {
+	execvp("cronolog", args - 1);
+    }
+    perror("cronolog");
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    char	*socket_path = ATTACH_SOCKET;
+    int		wait_daemon = 0;
+    int		conn;
+    char	c;
+    int		n;
+    int		i;
+
+    for (i = 1; i < argc; i++)
+    {
+	if (strncmp(argv[i], "--socket=", 9) == 0)
+	{
+	    socket_path = argv[i] + 9;
+	}
+	else if (strcmp(argv[i], "--wait") == 0)
+	{
+	    wait_daemon = 1;
+	}
+	else
+	{
+	    break;
+	}
+    }
+    if (i == argc)
+    {
+	fprintf(stderr, USAGE_MSG, argv[0]);
+	exit(1);
+    }
+
+    if ((conn = attach_send(socket_path, 0, argc - i, argv + i)) < 0)
+    {
+	if (errno == EINVAL)
+	{
+	    fprintf(stderr, "%s: the cronolog daemon refused the arguments\n", argv[0]);
+	}
+	else
+	{
+	    fprintf(stderr, "%s: cannot attach to the cronolog daemon: %s: %s\n",
+		    argv[0], socket_path, strerror(errno));
+	}
+	run_cronolog(argv[0], argv + i);
+    }
+    close(0);
+
+    /* With --wait, wait until the daemon closes the connection */
+
+    if (wait_daemon)
+    {
+	while (((n = read(conn, &c, 1)) > 0) || ((n < 0) && (errno == EINTR)))
+	{
+	}
+    }
+    close(conn);
+    return 0;
+}
@@ -78,18 +78,131 @@
  *	TransferLog "|/www/etc/cronolog /www/logs/%Y/%m/%d/access.log"
  *	ErrorLog    "|/www/etc/cronolog /www/logs/%Y/%m/%d/error.log"
  *
+ * Several templates may be given, in which case every block of data
+ * read is written to the current log file of each of them.  The
+ * options that describe an output (links and periods) apply to the
+ * template that follows them, for example:
+ *
+ *	cronolog -S /www/logs/access.log /www/logs/%Y/%m/%d/%H/access.log \
+ *		 -p 1day /www/archive/%Y%m%d.access.log
+ *
+ * The option "-L size" starts a new log file within a period whenever
+ * the current file would grow beyond the given size; the template
+ * must then contain the %N specifier, which is replaced by the
+ * sequence number of the file within the period (starting at 0).
+ *
+ * The option "-n count" writes each period of a template as that many
+ * files (shards), which must be distinguished by a %{shard}
+ * specifier in the template.  Whole lines are assigned to the shards
+ * in turn, or by a hash of a field of the line if "-k field" is given.
+ *
+ * The option "-I interval" writes a sparse time index alongside each
+ * log file (see cronoindex.c); the interval is either a period (e.g.
+ * "1 min") or an amount of data (e.g. "16M") and the option may be
+ * given once of each kind.
+ *
+ * The option "-G size" compresses the log files as a series of
+ * independent gzip members ("frames") of at most about that much log
+ * data and FRAME_MAX_SECONDS; the start of each frame is recorded in
+ * the time index so that a reader can decompress just the frames it
+ * needs.
+ *
+ * With the option "-q" cronolog does not read its input but prints the
+ * lines of the existing log files for the templates that were written
+ * between the times given with "-f" and "-t" (see cronoquery.c).
+ *
+ * With the option "-i file" (which may be given several times)
+ * cronolog reads the existing log files given, decompressing those
+ * compressed with gzip, bzip2 or zstd, instead of its standard input,
+ * and writes each line to the log file of the period given by its
+ * timestamp (see cronoinput.c).  With the option "-g" the files, each
+ * in time order (e.g. from several servers), are merged so that the
+ * log files are in time order too.  With the option "-j jobs" each
+ * large uncompressed file is split by that many threads, each parsing
+ * a part of it (see cronorange.c).  With the option "-r file" the
+ * progress of the split is recorded in "file", so that a split that
+ * is interrupted can be carried on by running the same command again
+ * (see cronocheckpoint.c).
+ *
+ * The option "-c file" appends a record describing each log file of
+ * the template to the catalog "file" when the log file is closed (see
+ * cronocatalog.c).
+ *
+ * The option "-K" keeps the CRC-32C checksum of each log file in a
+ * sidecar file FILE.sum.
+ *
+ * The option "-R keep" deletes old log files of the template: "keep"
+ * is a number of periods to keep (e.g. "30"), an age (e.g. "7 days")
+ * or a total size (e.g. "20G"), and the option may be given once of
+ * each kind (see cronoretain.c).
+ *
+ * The option "-F dir" keeps cronolog running if a log file cannot be
+ * opened or written: the data is held back in memory and then in a
+ * file in the fallback directory "dir" until the log file can be
+ * written again (see cronospill.c).
+ *
+ * The option "-J file" appends each block read to a write-ahead
+ * journal in "file" until the data has reached the log files, so that
+ * data held in memory is not lost if cronolog is killed; it is
+ * written out when cronolog is restarted (see cronojournal.c).
+ *
+ * The option "-C" coordinates cronolog processes writing the same
+ * template on one host through shared memory, so that only one of
+ * them creates the directories and replaces the links at the start of
+ * each period (see cronoshared.c).
+ *
+ * The option "-T format" prefixes each line written to the log files
+ * of the template with the time at which it was read, formatted with
+ * strftime() (see cronostamp.c).
+ *
+ * The option "-M file" measures how long data waits between being read
+ * and written to the log files, and how long rotations take, in
+ * histograms that are reported to "file" (or stderr if "file" is "-")
+ * on SIGUSR2 and on exit, and then started again (see cronohist.c).
+ *
  * The option "-x file" specifies that debugging messages should be
  * written to "file" (e.g. /dev/console) or to stderr if "file" is "-".
+ *
+ * The option "-X file" keeps a trace of the last reads, writes,
+ * rotations, directories created and links made in memory, and writes
+ * it to "file" on SIGUSR1, on a crash and on exit, to be printed with
+ * cronodump (see cronotrace.c).
+ *
+ * The option "-m" writes the log files through memory-mapped windows
+ * rather than with a write() call for each buffer read (see
+ * cronowrite.c).
+ *
+ * With the option "-b name" cronolog also takes log records from the
+ * shared memory ring "name", filled by programs linked with
+ * libcronolog, between the lines of its standard input, and carries
+ * on when its standard input is closed (see cronoring.c).
+ *
+ * With the options "-u path" and "-U path" cronolog also listens on
+ * the Unix domain stream and datagram sockets "path" and logs what the
+ * clients send, again between the lines of its standard input.  A
+ * connection or a datagram that starts with "@tag" goes to the
+ * template given the option "-A tag"; everything else goes to the
+ * templates without a tag (see cronolisten.c).
+ *
+ * With the option "-D path" cronolog runs as a daemon that takes over
+ * the pipes handed to it on the socket "path" by cronolog-attach, and
+ * logs each of them with the template and options sent along with it,
+ * so that one process serves the logs of many servers (see
+ * cronoattach.c).
  */
 
 #include "cronoutils.h"
 #include "getopt.h"
-
-
-/* Forward function declaration */
-
-int	new_log_file(const char *, const char *, mode_t, const char *,
-		     PERIODICITY, int, int, char *, size_t, time_t, time_t *);
+#ifndef _WIN32
+#include <signal.h>
+#endif
+#if HAVE_POLL_H
+#include <poll.h>
+#endif
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_UN_H
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#endif
 
 
 /* Definition of version and usage messages */
@@ -101,7 +214,7 @@ int	new_log_file(const char *, const char *, mode_t, const char *,
 #endif
 
 
-#define USAGE_MSG 	"usage: %s [OPTIONS] logfile-spec\n" \
+#define USAGE_MSG 	"usage: %s [OPTIONS] logfile-spec [[OPTIONS] logfile-spec ...]\n" \
 			"\n" \
 			"   -H NAME,   --hardlink=NAME maintain a hard link from NAME to current log\n" \
 			"   -S NAME,   --symlink=NAME  maintain a symbolic link from NAME to current log\n" \
@@ -111,8 +224,46 @@ int	new_log_file(const char *, const char *, mode_t, const char *,
 			"   -p PERIOD, --period=PERIOD set the rotation period explicitly\n" \
 			"   -d DELAY,  --delay=DELAY   set the rotation period delay\n" \
 			"   -o,        --once-only     create single output log from template (not rotated)\n" \
+			"   -L SIZE,   --size-limit=SIZE  also rotate when the log reaches SIZE (k, M or G)\n" \
+			"                              (the template must contain %%N, the sequence number)\n" \
+			"   -n COUNT,  --shards=COUNT  write each period as COUNT files (template needs %%{shard})\n" \
+			"   -k FIELD,  --shard-key=FIELD  choose the shard of a line by hashing FIELD\n" \
+			"                              (default is to assign lines in turn)\n" \
+			"   -I INTERVAL, --index=INTERVAL  write a time index (FILE.idx) with a record\n" \
+			"                              every INTERVAL of time (e.g. 1min) or data (e.g. 16M)\n" \
+			"   -G SIZE,   --gzip-frames=SIZE  compress log files as independent gzip frames\n" \
+			"                              of SIZE bytes of log data, indexed in FILE.idx\n" \
+			"   -c FILE,   --catalog=FILE  record each closed log file in the catalog FILE\n" \
+			"   -T FORMAT, --timestamp=FORMAT  prefix each line with the time in FORMAT\n" \
+			"   -K,        --checksum      keep the CRC-32C of each log file in FILE.sum\n" \
+			"   -R KEEP,   --retain=KEEP   delete old log files, keeping KEEP periods (e.g. 30),\n" \
+			"                              periods younger than KEEP (e.g. 7days) or KEEP bytes (e.g. 20G)\n" \
+			"   -F DIR,    --fallback=DIR  if a log file cannot be written, hold data back\n" \
+			"                              in memory and then in DIR until it can\n" \
+			"   -J FILE,   --journal=FILE  keep data not yet in the log files in the journal FILE\n" \
+			"   -C,        --coordinate    share period state with other cronologs on this host\n" \
+			"   -m,        --mmap          write log files through memory-mapped windows\n" \
+			"   -b NAME,   --ring=NAME     also log the records of the shared memory ring NAME\n" \
+			"   -u PATH,   --listen=PATH   also log what clients send to the stream socket PATH\n" \
+			"   -U PATH,   --listen-dgram=PATH  also log the datagrams sent to the socket PATH\n" \
+			"   -A TAG,    --tag=TAG       give this template what is sent with the prefix @TAG\n" \
+			"   -D PATH,   --daemon=PATH   log the pipes handed over by cronolog-attach on the\n" \
+			"                              socket PATH (instead of templates given here)\n" \
+			"   -q,        --query         print the logged lines between the --from and --to times\n" \
+			"   -f TIME,   --from=TIME     start of the time range for --query\n" \
+			"   -t TIME,   --to=TIME       end of the time range for --query (default now)\n" \
+			"   -i FILE,   --input=FILE    split the existing log FILE (which may be compressed)\n" \
+			"                              into the log files instead of reading standard input\n" \
+			"   -g,        --merge         merge the --input files in time order\n" \
+			"   -j JOBS,   --jobs=JOBS     split large uncompressed --input files with JOBS threads\n" \
+			"   -r FILE,   --resume=FILE   record the progress of splitting the --input files\n" \
+			"                              in FILE and carry on from it if interrupted\n" \
 			"   -x FILE,   --debug=FILE    write debug messages to FILE\n" \
 			"                              ( or to standard error if FILE is \"-\")\n" \
+			"   -M FILE,   --latency=FILE  report write and rotation latency to FILE\n" \
+			"                              on SIGUSR2 or on exit\n" \
+			"   -X FILE,   --trace=FILE    keep a trace of recent events, written to FILE\n" \
+			"                              on SIGUSR1, on a crash or on exit\n" \
 			"   -a,        --american         American date formats\n" \
 			"   -e,        --european      European date formats (default)\n" \
 			"   -s TIME,   --start-time=TIME   starting time\n" \
@@ -120,9 +271,13 @@ int	new_log_file(const char *, const char *, mode_t, const char *,
 			"   -V,        --version       print version number, then exit\n"
 
 
-/* Definition of the short and long program options */
+/* Definition of the short and long program options
+ * (the leading "-" makes getopt return each template in turn as
+ * option character 1, so that options can be associated with the
+ * template that follows them)
+ */
 
-char          *short_options = "ad:eop:s:z:H:P:S:l:hVx:";
+char          *short_options = "-ab:c:d:ef:gi:j:k:mn:op:qr:s:t:u:z:A:CD:F:G:H:I:J:KL:M:P:R:S:T:U:l:hVx:X:";
 
 #ifndef _WIN32
 struct option long_options[] =
@@ -138,35 +293,1907 @@ struct option long_options[] =
     { "period",		required_argument,	NULL, 'p' },
     { "delay",		required_argument,	NULL, 'd' },
     { "once-only", 	no_argument,       	NULL, 'o' },
+    { "mmap",		no_argument,		NULL, 'm' },
+    { "ring",		required_argument,	NULL, 'b' },
+    { "listen",		required_argument,	NULL, 'u' },
+    { "listen-dgram",	required_argument,	NULL, 'U' },
+    { "tag",		required_argument,	NULL, 'A' },
+    { "daemon",		required_argument,	NULL, 'D' },
+    { "fallback",	required_argument,	NULL, 'F' },
+    { "journal",	required_argument,	NULL, 'J' },
+    { "coordinate",	no_argument,		NULL, 'C' },
+    { "size-limit",	required_argument,	NULL, 'L' },
+    { "shards",		required_argument,	NULL, 'n' },
+    { "shard-key",	required_argument,	NULL, 'k' },
+    { "index",		required_argument,	NULL, 'I' },
+    { "gzip-frames",	required_argument,	NULL, 'G' },
+    { "catalog",	required_argument,	NULL, 'c' },
+    { "checksum",	no_argument,		NULL, 'K' },
+    { "timestamp",	required_argument,	NULL, 'T' },
+    { "retain",		required_argument,	NULL, 'R' },
+    { "query",		no_argument,		NULL, 'q' },
+    { "from",		required_argument,	NULL, 'f' },
+    { "to",		required_argument,	NULL, 't' },
+    { "input",		required_argument,	NULL, 'i' },
+    { "merge",		no_argument,		NULL, 'g' },
+    { "jobs",		required_argument,	NULL, 'j' },
+    { "resume",		required_argument,	NULL, 'r' },
+    { "trace",		required_argument,	NULL, 'X' },
+    { "latency",	required_argument,	NULL, 'M' },
     { "help",      	no_argument,       	NULL, 'h' },
-    { "version",   	no_argument,       	NULL, 'V' }
+    { "version",   	no_argument,       	NULL, 'V' },
+    { NULL,		0,			NULL, 0 }
 };
 #endif
 
+
+#ifndef _WIN32
+/* Set by the termination signal handler so that the main loop can
+ * close the current log file cleanly (only installed for the mmap
+ * engine, which must truncate the file to its real length on exit,
+ * with a fallback directory, where the data held in memory must be
+ * saved, for compressed files, whose last frame must be finished, for a
+ * catalog or checksums, which record each file as it is closed, and
+ * with a ring, sockets or --daemon, which keep cronolog running after
+ * the end of its input).
+ */
+static volatile sig_atomic_t	terminate_signal = 0;
+
+static void
+handle_termination(int sig)
+{
+    terminate_signal = sig;
+}
+
+static void
+catch_termination(void)
+{
+    struct sigaction	sa;
+
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = handle_termination;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGHUP,  &sa, NULL);
+}
+
+/* Set by the SIGUSR2 handler to ask the main loop for a latency
+ * report.
+ */
+static volatile sig_atomic_t	report_signal = 0;
+
+static void
+handle_report(int sig)
+{
+    report_signal = sig;
+}
+#endif
+
+
+/* Set if the mmap write engine is used for all log files */
+
+static int	use_mmap = 0;
+
+/* Other sources of log data taken between the lines of the input: a
+ * shared memory ring (with a descriptor that shows when it has
+ * records, or -1 if it is polled) and listening sockets (with the
+ * epoll descriptor that watches them).
+ */
+static char	*ring_name     = NULL;
+static int	ring_fd        = -1;
+static char	*listen_stream = NULL;
+static char	*listen_dgram  = NULL;
+static int	listen_fd      = -1;
+
+/* Latency histograms, kept if a report file was given: the time from
+ * reading a block of input to having written it to every log file
+ * (from the earlier read if an incomplete line was held back), and
+ * the time taken to close a log file and start the next.
+ */
+static char		*latency_file = NULL;
+static time_t		latency_since;
+static HISTOGRAM	write_latency;
+static HISTOGRAM	rotate_latency;
+
+/* Append a report of the latency histograms to the report file and
+ * start them again.
+ */
+static void
+report_latency(void)
+{
+    FILE	*fp = stderr;
+    time_t	now = time(NULL);
+
+    if ((strcmp(latency_file, "-") != 0) && (fp = fopen(latency_file, "a")) == NULL)
+    {
+	perror(latency_file);
+	return;
+    }
+    fprintf(fp, "# from %s", timestamp(latency_since));
+    fprintf(fp, " to %s\n", timestamp(now));
+    hist_print(fp, "write", &write_latency);
+    hist_print(fp, "rotate", &rotate_latency);
+    if (fp != stderr)
+    {
+	fclose(fp);
+    }
+    hist_reset(&write_latency);
+    hist_reset(&rotate_latency);
+    latency_since = now;
+}
+
+/* Close the current log file of an output and its index, recording
+ * the file in the catalog.
+ */
+static void
+close_output(LOG_OUTPUT *output)
+{
+    if (output->writer.fd < 0)
+    {
+	return;
+    }
+    if (log_writer_end_frame(&output->writer) < 0)
+    {
+	perror(output->filename);
+    }
+    catalog_record(output);
+    checksum_record(output);
+    index_close(output);
+    log_writer_close(&output->writer);
+}
+
+/* Close the log files of all outputs, saving any data held back.
+ */
+static void
+close_outputs(LOG_OUTPUT *outputs, int n_outputs)
+{
+    int		i;
+
+    for (i = 0; i < n_outputs; i++)
+    {
+	close_output(&outputs[i]);
+	spill_close(&outputs[i]);
+    }
+}
+
+/* Set the journal mark of each output that holds no data in memory
+ * to the end of the input read so far, less any incomplete line held
+ * back for a sharded template.  The mark of an output with an
+ * unfinished compressed frame was set when the frame was started and
+ * that of an output holding data back in degraded mode when it
+ * started doing so.
+ */
+static void
+mark_outputs(LOG_OUTPUT *outputs, int n_outputs, off_t end)
+{
+    LOG_OUTPUT	*output;
+
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if ((output->pool_len == 0) && !output->writer.frame_open)
+	{
+	    journal_mark(output->journal_slot,
+			 end - (output - output->shard)->partial_len, NULL, 0);
+	}
+    }
+}
+
+/* Write out the data held in memory by the outputs (apart from
+ * incomplete lines) so that the journal can be emptied when it is
+ * full: finish the current compressed frames and move data held back
+ * in degraded mode to the spill files.
+ */
+static void
+sync_outputs(LOG_OUTPUT *outputs, int n_outputs)
+{
+    LOG_OUTPUT	*output;
+
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if ((output->writer.fd >= 0) && (log_writer_end_frame(&output->writer) < 0))
+	{
+	    perror(output->filename);
+	}
+	spill_save(output);
+    }
+}
+
+/* Put an output into degraded mode after its log file could not be
+ * opened or written, holding back the data that was not written (all
+ * but the first skip bytes of the vector).  The log file is kept open
+ * to be retried after SPILL_RETRY seconds, unless it is compressed,
+ * as part of the current frame is then lost.
+ */
+static void
+degrade_output(LOG_OUTPUT *output, const struct iovec *iov, int iovcnt, size_t skip,
+	       time_t time_now)
+{
+    if (!output->degraded)
+    {
+	fprintf(stderr, "%s: holding back log data until the file can be written\n",
+		output->filename);
+    }
+    if (output->frame_size)
+    {
+	close_output(output);
+    }
+    output->degraded   = 1;
+    output->retry_time = time_now + SPILL_RETRY;
+    spill_writev(output, iov, iovcnt, skip);
+}
+
+/* Assign a complete line to one of the shards of a template: by a
+ * hash of the key field if one was specified, otherwise in turn.  The
+ * rest of a line too long to be held back whole goes to the shard
+ * that was given the start of it.
+ */
+static void
+shard_line(LOG_OUTPUT *shards, const char *line, size_t len)
+{
+    LOG_OUTPUT		*shard;
+    unsigned long	hash = 2166136261UL;
+    const char		*p   = line;
+    const char		*end = line + len;
+    int			field;
+
+    if (shards->split_line)
+    {
+	shard = shards + shards->last_shard;
+    }
+    else if (shards->shard_key)
+    {
+	/* FNV-1a hash of the key field (fields are separated by
+	 * spaces or tabs and numbered from 1) */
+
+	for (field = 1; field < shards->shard_key && p < end; field++)
+	{
+	    while (p < end && *p != ' ' && *p != '\t') { p++; }
+	    while (p < end && (*p == ' ' || *p == '\t')) { p++; }
+	}
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\n')
+	{
+	    hash = ((hash ^ (unsigned char)*p++) * 16777619UL) & 0xffffffffUL;
+	}
+	shard = shards + (hash % shards->n_shards);
+    }
+    else
+    {
+	shard = shards + shards->next_shard;
+	shards->next_shard = (shards->next_shard + 1) % shards->n_shards;
+    }
+    memcpy(shard->shard_buf + shard->shard_buf_len, line, len);
+    shard->shard_buf_len += len;
+    shards->last_shard = shard - shards;
+    shards->split_line = (len > 0) && (line[len - 1] != '\n');
+}
+
+/* Split a block of data into lines and assign them to the shards of a
+ * template.  An incomplete line at the end of the block is held back
+ * (in the first shard) until the rest of it is read; if flush is set
+ * it is assigned as it is.
+ */
+static void
+shard_lines(LOG_OUTPUT *shards, const char *data, size_t len, int flush)
+{
+    const char	*nl;
+    size_t	n;
+
+    if (shards->partial_len > 0)
+    {
+	nl = memchr(data, '\n', len);
+	n  = nl ? (size_t)(nl - data) + 1 : len;
+	memcpy(shards->partial + shards->partial_len, data, n);
+	shards->partial_len += n;
+	data += n;
+	len  -= n;
+	if (nl || flush || shards->partial_len >= BUFSIZE)
+	{
+	    shard_line(shards, shards->partial, shards->partial_len);
+	    shards->partial_len = 0;
+	}
+    }
+    while ((len > 0) && (nl = memchr(data, '\n', len)) != NULL)
+    {
+	n = (nl - data) + 1;
+	shard_line(shards, data, n);
+	data += n;
+	len  -= n;
+    }
+    if (len > 0)
+    {
+	if (flush)
+	{
+	    shard_line(shards, data, len);
+	}
+	else
+	{
+	    memcpy(shards->partial, data, len);
+	    shards->partial_len = len;
+	}
+    }
+}
+
+/* Open a new log file for an output.  If the file cannot be opened
+ * the data of the I/O vector is held back in degraded mode and -1 is
+ * returned.  rotate_start is the time the rotation started (for the
+ * latency histogram).
+ */
+static int
+open_output(LOG_OUTPUT *output, const struct iovec *iov, int iovcnt, time_t time_now,
+	    unsigned long long rotate_start)
+{
+    int		log_fd;
+
+    log_fd = new_log_file(output, time_now);
+    if (   (log_fd >= 0)
+	&& (log_writer_open(&output->writer, log_fd, use_mmap, output->frame_size,
+			    (output->catalog_fd >= 0) || output->write_sum) < 0))
+    {
+	perror(output->filename);
+	close(log_fd);
+	output->writer.fd = log_fd = -1;
+    }
+    if (log_fd < 0)
+    {
+	if (spill_dir == NULL)
+	{
+	    exit(2);
+	}
+	degrade_output(output, iov, iovcnt, 0, time_now);
+	return -1;
+    }
+    checkpoint_opened(output->filename, output->writer.length);
+    index_open(output);
+    checksum_open(output);
+    retain_logs(output, time_now);
+    output->first_write = time_now;
+    if (latency_file)
+    {
+	hist_record(&rotate_latency, hist_now() - rotate_start);
+    }
+    return 0;
+}
+
+/* Count the bytes of the complete lines at the start of an I/O vector
+ * that fit in room bytes.  If none fit and first is set, count the
+ * bytes of the first line instead (all of the data if there is no
+ * newline).
+ */
+static size_t
+fit_lines(const struct iovec *iov, int iovcnt, size_t room, int first)
+{
+    const char	*base;
+    const char	*nl;
+    size_t	offset = 0;
+    size_t	fit    = 0;
+    size_t	i;
+    int		n;
+
+    for (n = 0; n < iovcnt; n++)
+    {
+	base = iov[n].iov_base;
+	for (i = 0; (nl = memchr(base + i, '\n', iov[n].iov_len - i)) != NULL; )
+	{
+	    i = (nl - base) + 1;
+	    if (offset + i > room)
+	    {
+		return ((fit == 0) && first) ? offset + i : fit;
+	    }
+	    fit = offset + i;
+	}
+	offset += iov[n].iov_len;
+    }
+    return ((fit == 0) && first) ? offset : fit;
+}
+
+/* Write the data of an I/O vector to the open log file of an output.
+ */
+static void
+write_file(LOG_OUTPUT *output, const struct iovec *iov, int iovcnt, size_t len,
+	   time_t time_now)
+{
+    int		n;
+
+    output->last_write = time_now;
+
+    /* If the log file is compressed then finish the current frame if
+     * it is big or old enough and record the start of each new frame
+     * in the index; otherwise just index the data at the intervals
+     * requested.
+     */
+    if (output->frame_size)
+    {
+	if (   output->writer.frame_open
+	    && (   (output->writer.frame_bytes >= output->frame_size)
+		|| (time_now >= output->frame_time + FRAME_MAX_SECONDS)))
+	{
+	    if (log_writer_end_frame(&output->writer) < 0)
+	    {
+		perror(output->filename);
+		exit(5);
+	    }
+	}
+	if (!output->writer.frame_open)
+	{
+	    output->frame_time = time_now;
+	    index_record(output, time_now, output->writer.length);
+	    journal_mark(output->journal_slot, (output - output->shard)->journal_start,
+			 output->filename, output->writer.length);
+	}
+    }
+    else
+    {
+	index_note(output, time_now);
+    }
+
+    /* Write out any data held back before the new data.
+     */
+    if (output->degraded && (spill_resume(output) < 0))
+    {
+	perror(output->filename);
+	degrade_output(output, iov, iovcnt, 0, time_now);
+	return;
+    }
+
+    /* Write out the log data to the current log file, holding back
+     * whatever could not be written in degraded mode.
+     */
+    n = log_writer_writev(&output->writer, iov, iovcnt);
+    TRACE(TRACE_WRITE, output->number, n, output->writer.length, NULL);
+    if (n != (int)len)
+    {
+	if (n < 0)
+	{
+	    perror(output->filename);
+	    n = 0;
+	}
+	else
+	{
+	    fprintf(stderr, "%s: short write\n", output->filename);
+	}
+	if (spill_dir == NULL)
+	{
+	    exit(5);
+	}
+	degrade_output(output, iov, iovcnt, n, time_now);
+    }
+}
+
+/* Write the data of an I/O vector to an output, first closing the
+ * current log file if its period has finished and opening a new log
+ * file if needed.  If the data would take the log file past its size
+ * limit the complete lines that fit are written (or the first line if
+ * the file is empty) and the rest goes to the next file in sequence
+ * (new_log_file() moves on to the next sequence number); this also
+ * applies to the first write to a file reopened after a restart.  The
+ * entries of the vector are altered.
+ */
+static void
+write_iov(LOG_OUTPUT *output, struct iovec *iov, int iovcnt, time_t time_now)
+{
+    unsigned long long	rotate_start = 0;
+    size_t	len;
+    size_t	fit;
+    size_t	done;
+    size_t	save;
+    int		n;
+
+    for (len = 0, n = 0; n < iovcnt; n++)
+    {
+	len += iov[n].iov_len;
+    }
+
+    /* While the output is degraded the data is held back until it is
+     * time to retry writing the log file.
+     */
+    if (output->degraded && (time_now < output->retry_time))
+    {
+	spill_writev(output, iov, iovcnt, 0);
+	return;
+    }
+
+    /* If the current period has finished and there is a log file
+     * open, close the log file
+     */
+    if (latency_file)
+    {
+	rotate_start = hist_now();
+    }
+    if ((time_now >= output->next_period) && (output->writer.fd >= 0))
+    {
+	close_output(output);
+    }
+
+    /* Data from before the period of the log file (when splitting
+     * existing log files) goes back to the file of its own period.
+     */
+    if (   (time_now < output->period_start) && (output->periodicity != ONCE_ONLY)
+	&& (output->writer.fd >= 0))
+    {
+	close_output(output);
+    }
+	
+    /* If there is no log file open then open a new one.
+     */
+    if ((output->writer.fd < 0) && (open_output(output, iov, iovcnt, time_now, rotate_start) < 0))
+    {
+	return;
+    }
+
+    while (   output->max_size && (len > 0)
+	   && (output->writer.length + (off_t)len > output->max_size))
+    {
+	fit = fit_lines(iov, iovcnt,
+			(output->writer.length < output->max_size)
+			? output->max_size - output->writer.length : 0,
+			output->writer.length == 0);
+	if (fit > 0)
+	{
+	    for (n = 0, done = 0; done + iov[n].iov_len < fit; n++)
+	    {
+		done += iov[n].iov_len;
+	    }
+	    save = iov[n].iov_len;
+	    iov[n].iov_len = fit - done;
+	    write_file(output, iov, n + 1, fit, time_now);
+	    iov[n].iov_base = (char *)iov[n].iov_base + (fit - done);
+	    iov[n].iov_len  = save - (fit - done);
+	    iov    += n;
+	    iovcnt -= n;
+	    len    -= fit;
+	    if (output->degraded)
+	    {
+		spill_writev(output, iov, iovcnt, 0);
+		return;
+	    }
+	}
+	if (len == 0)
+	{
+	    return;
+	}
+	DEBUG(("\"%s\" has reached its size limit\n", output->filename));
+	if (latency_file)
+	{
+	    rotate_start = hist_now();
+	}
+	output->size_reached = 1;
+	close_output(output);
+	if (open_output(output, iov, iovcnt, time_now, rotate_start) < 0)
+	{
+	    return;
+	}
+    }
+    write_file(output, iov, iovcnt, len, time_now);
+}
+
+/* Write a block of data to an output.  If the output has a timestamp
+ * format each line is prefixed with the time, the lines being passed
+ * to the writer a staging buffer or STAMP_LINES long lines at a time.
+ */
+static void
+write_output(LOG_OUTPUT *output, const char *data, int len, time_t time_now)
+{
+    static char		stage[STAMP_STAGE];
+    struct iovec	iov[2 * STAMP_LINES];
+    size_t		used;
+    int			n;
+
+    if (output->stamp_format == NULL)
+    {
+	iov[0].iov_base = (char *)data;
+	iov[0].iov_len  = len;
+	write_iov(output, iov, 1, time_now);
+	return;
+    }
+    while (len > 0)
+    {
+	n = stamp_lines(output, data, len, time_now, iov, 2 * STAMP_LINES,
+			stage, sizeof (stage), &used);
+	write_iov(output, iov, n, time_now);
+	data += used;
+	len  -= used;
+    }
+}
+
+/* Write a block of data read from the input to every output.  The
+ * data is split into lines for sharded templates, and each shard
+ * gets a single write of the lines assigned to it.  The shard buffers
+ * hold 2 * BUFSIZE bytes (a held back line and a block), so a longer
+ * block (a long line when splitting or merging files) is divided
+ * among the shards BUFSIZE bytes at a time.  position is the position
+ * of the data in the input (for the journal).
+ */
+static void
+write_outputs(LOG_OUTPUT *outputs, int n_outputs, const char *data, int len,
+	      time_t time_now, int flush, off_t position)
+{
+    LOG_OUTPUT	*output;
+    LOG_OUTPUT	*shard;
+    int		done;
+    int		piece;
+
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (output->shard == 0)
+	{
+	    output->journal_start = position - output->partial_len;
+	}
+	if (output->n_shards > 1)
+	{
+	    if (output->shard != 0)
+	    {
+		continue;
+	    }
+	    done = 0;
+	    do
+	    {
+		piece = (len - done > BUFSIZE) ? BUFSIZE : len - done;
+		shard_lines(output, data + done, piece, flush && (done + piece == len));
+		done += piece;
+		for (shard = output; shard < output + output->n_shards; shard++)
+		{
+		    if (shard->shard_buf_len > 0)
+		    {
+			write_output(shard, shard->shard_buf, shard->shard_buf_len, time_now);
+			shard->shard_buf_len = 0;
+		    }
+		}
+	    }
+	    while (done < len);
+	}
+	else if (len > 0)
+	{
+	    write_output(output, data, len, time_now);
+	}
+    }
+}
+
+/* Write a block of data to the templates with the given tag, or to
+ * the templates without a tag if tag is NULL or no template has it.
+ */
+static void
+route_outputs(LOG_OUTPUT *outputs, int n_outputs, const char *tag, const char *data,
+	      int len, time_t time_now, off_t position)
+{
+    LOG_OUTPUT	*group;
+    int		found = 0;
+
+    if (tag)
+    {
+	for (group = outputs; group < outputs + n_outputs; group += group->n_shards)
+	{
+	    if (group->tag && (strcmp(group->tag, tag) == 0))
+	    {
+		write_outputs(group, group->n_shards, data, len, time_now, 0, position);
+		found = 1;
+	    }
+	}
+    }
+    if (!found)
+    {
+	for (group = outputs; group < outputs + n_outputs; group += group->n_shards)
+	{
+	    if (group->tag == NULL)
+	    {
+		write_outputs(group, group->n_shards, data, len, time_now, 0, position);
+	    }
+	}
+    }
+}
+
+#if HAVE_POLL_H
+/* Finish the compressed frames that have been open for
+ * FRAME_MAX_SECONDS, so that the data of an idle log file can be read.
+ */
+static void
+end_old_frames(LOG_OUTPUT *outputs, int n_outputs, time_t time_now)
+{
+    LOG_OUTPUT	*output;
+
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (   output->writer.frame_open
+	    && (time_now >= output->frame_time + FRAME_MAX_SECONDS)
+	    && (log_writer_end_frame(&output->writer) < 0))
+	{
+	    perror(output->filename);
+	    exit(5);
+	}
+    }
+}
+
+/* Wait for standard input (while it is open), for records in the
+ * ring given with --ring or for data on the sockets given with
+ * --listen and --listen-dgram, writing out the records and the data
+ * unless the input read so far ends in the middle of a line, and
+ * until the oldest open compressed frame is due to be finished.
+ *
+ * Returns 1 if standard input can be read, else 0.
+ */
+static int
+wait_for_input(LOG_OUTPUT *outputs, int n_outputs, int stdin_open, int mid_line,
+	       time_t time_offset)
+{
+    static char		buf[BUFSIZE];
+    struct pollfd	fds[3];
+    LOG_OUTPUT		*output;
+    const char		*tag;
+    time_t		time_now = time(NULL) + time_offset;
+    time_t		due;
+    int			timeout;
+    int			n_fds = 0;
+    int			ring = -1;
+    int			sockets = -1;
+    ssize_t		n;
+
+    if (stdin_open)
+    {
+	fds[n_fds].fd       = 0;
+	fds[n_fds++].events = POLLIN;
+    }
+    if (!mid_line && (ring_fd >= 0))
+    {
+	ring = n_fds;
+	fds[n_fds].fd       = ring_fd;
+	fds[n_fds++].events = POLLIN;
+    }
+    if (!mid_line && (listen_fd >= 0))
+    {
+	sockets = n_fds;
+	fds[n_fds].fd       = listen_fd;
+	fds[n_fds++].events = POLLIN;
+    }
+    timeout = (ring_name && (ring_fd < 0)) ? RING_POLL_MS : -1;
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (output->writer.frame_open)
+	{
+	    due = output->frame_time + FRAME_MAX_SECONDS - time_now;
+	    if (due < 0)
+	    {
+		due = 0;
+	    }
+	    if ((timeout < 0) || (due * 1000 < timeout))
+	    {
+		timeout = due * 1000;
+	    }
+	}
+    }
+    if (poll(fds, n_fds, timeout) < 0)
+    {
+	return 0;
+    }
+    end_old_frames(outputs, n_outputs, time(NULL) + time_offset);
+    if (!mid_line && ring_name && ((ring < 0) || (fds[ring].revents & POLLIN)))
+    {
+	while ((n = ring_read(buf, sizeof (buf))) > 0)
+	{
+	    route_outputs(outputs, n_outputs, NULL, buf, n, time(NULL) + time_offset, 0);
+	}
+	ring_drained();
+    }
+    if ((sockets >= 0) && (fds[sockets].revents & POLLIN))
+    {
+	while ((n = listen_read(buf, sizeof (buf), &tag)) > 0)
+	{
+	    route_outputs(outputs, n_outputs, tag, buf, n, time(NULL) + time_offset, 0);
+	}
+    }
+    return stdin_open && (fds[0].revents & (POLLIN|POLLHUP|POLLERR));
+}
+#else
+static int
+wait_for_input(LOG_OUTPUT *outputs, int n_outputs, int stdin_open, int mid_line,
+	       time_t time_offset)
+{
+    return 1;
+}
+#endif
+
+/* Write out the input left in the journal by the last cronolog
+ * process to the log files of the periods in which it was read.  The
+ * files of each template are given the input from the oldest mark of
+ * any of them, after truncating any compressed file with an
+ * unfinished frame to the start of that frame.  (A sharded template
+ * whose shards have different marks can therefore get some lines
+ * twice.)
+ */
+static void
+replay_journal(LOG_OUTPUT *outputs, int n_outputs)
+{
+    LOG_OUTPUT	*group;
+    char	buf[BUFSIZE];
+    const char	*filename;
+    off_t	offset;
+    off_t	start = 0;
+    off_t	mark;
+    off_t	pos;
+    off_t	skip;
+    time_t	read_time = 0;
+    int		n;
+    int		i;
+
+    for (group = outputs; group < outputs + n_outputs; group += group->n_shards)
+    {
+	for (i = 0; i < group->n_shards; i++)
+	{
+	    mark = journal_get_mark(group[i].journal_slot, &filename, &offset);
+	    if (filename && (truncate(filename, offset) == 0))
+	    {
+		DEBUG(("Truncated \"%s\" to its last complete frame at %ld\n",
+		       filename, (long)offset));
+	    }
+	    if ((i == 0) || (mark < start))
+	    {
+		start = mark;
+	    }
+	}
+	journal_rewind();
+	while ((n = journal_next(buf, sizeof (buf), &read_time, &pos)) > 0)
+	{
+	    if (pos + n <= start)
+	    {
+		continue;
+	    }
+	    skip = (start > pos) ? start - pos : 0;
+	    write_outputs(group, group->n_shards, buf + skip, n - skip, read_time, 0, pos + skip);
+	}
+	write_outputs(group, group->n_shards, buf, 0, read_time, 1, journal_position());
+	close_outputs(group, group->n_shards);
+    }
+    journal_reset();
+}
+
+/* Merge the lines of existing log files, each in time order, into
+ * the log files of the periods in which they were logged.  Lines are
+ * gathered into a buffer while they have the same time so that the
+ * log files are written in blocks rather than line by line.
+ *
+ * Returns the number of lines that could not be dated.
+ */
+static long
+merge_inputs(LOG_OUTPUT *outputs, int n_outputs, char **inputs, int n_inputs)
+{
+    static char	buf[BUFSIZE];
+    size_t	buf_len = 0;
+    time_t	buf_time = -1;
+    const char	*line;
+    ssize_t	len;
+    time_t	line_time;
+    long	undated = 0;
+
+    if (input_open(inputs, n_inputs, 1, 0) < 0)
+    {
+	perror("input");
+	exit(1);
+    }
+    while ((len = input_merge_next(&line, &line_time)) > 0)
+    {
+	if (line_time == -1)
+	{
+	    undated++;
+	    continue;
+	}
+	if (   (buf_len > 0)
+	    && ((line_time != buf_time) || (buf_len + (size_t)len > sizeof (buf))))
+	{
+	    write_outputs(outputs, n_outputs, buf, buf_len, buf_time, 0, 0);
+	    buf_len = 0;
+	}
+
+	/* A line longer than the buffer is written on its own
+	 * (write_outputs() divides it among the shards of a sharded
+	 * template in pieces).
+	 */
+	if ((size_t)len > sizeof (buf))
+	{
+	    write_outputs(outputs, n_outputs, line, len, line_time, 0, 0);
+	    continue;
+	}
+	memcpy(buf + buf_len, line, len);
+	buf_len += len;
+	buf_time = line_time;
+    }
+    if (buf_len > 0)
+    {
+	write_outputs(outputs, n_outputs, buf, buf_len, buf_time, 0, 0);
+    }
+    input_close();
+    write_outputs(outputs, n_outputs, "", 0, buf_time, 1, 0);
+    close_outputs(outputs, n_outputs);
+    return undated;
+}
+
+/* Tell whether the log files of the outputs can be written by
+ * copying runs of lines straight from the input file, that is
+ * whether every byte written is a byte of the input and nothing else
+ * depends on the individual lines or the amount written.
+ */
+static int
+can_copy_ranges(LOG_OUTPUT *outputs, int n_outputs)
+{
+    LOG_OUTPUT	*output;
+
+    if (use_mmap || spill_dir)
+    {
+	return 0;
+    }
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (   (output->n_shards > 1) || output->max_size || output->period_delay
+	    || output->index_interval || output->index_bytes || output->frame_size
+	    || output->catalog || output->write_sum || output->stamp_format)
+	{
+	    DEBUG(("\"%s\" cannot be written in parallel\n", output->template));
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/* Split an uncompressed log file (inputs[input]) from offset skip
+ * into the log files of the periods in which its lines were logged,
+ * with jobs threads parsing the file and the main thread copying the
+ * runs of lines that go to the same log files in the order of the
+ * file.  last_time is the time of the line before (or -1).
+ *
+ * Returns the number of lines that could not be dated, or -1 if the
+ * file cannot be split this way (it is compressed).
+ */
+static long
+copy_ranges(LOG_OUTPUT *outputs, int n_outputs, char **inputs, int input, int jobs,
+	    off_t skip, time_t last_time)
+{
+    LOG_OUTPUT		*output;
+    RANGE_SEGMENT	seg;
+    long		undated = 0;
+    char		last_char = '\n';
+    off_t		since_mark = 0;
+    ssize_t		n;
+    int			log_fd;
+
+    if (range_open(inputs[input], skip, outputs, n_outputs, jobs) < 0)
+    {
+	if ((errno == EINVAL) || (errno == ENOSYS))
+	{
+	    return -1;
+	}
+	perror(inputs[input]);
+	return 0;
+    }
+    while (range_next(&seg))
+    {
+	TRACE(TRACE_READ, -1, seg.len, seg.offset + seg.len, NULL);
+	if (since_mark >= CHECKPOINT_BYTES)
+	{
+	    checkpoint_mark(outputs, n_outputs, inputs, input, seg.offset, last_time);
+	    since_mark = 0;
+	}
+	since_mark += seg.len;
+	if (seg.time == -1)
+	{
+	    if (last_time == -1)
+	    {
+		undated += seg.undated;
+		continue;
+	    }
+	    seg.time = last_time;
+	}
+	last_time = seg.time;
+	last_char = seg.data[seg.len - 1];
+
+	for (output = outputs; output < outputs + n_outputs; output++)
+	{
+	    if (   (output->writer.fd >= 0)
+		&& (   (seg.time >= output->next_period)
+		    || ((seg.time < output->period_start) && (output->periodicity != ONCE_ONLY))))
+	    {
+		close_output(output);
+	    }
+	    if (output->writer.fd < 0)
+	    {
+		if (   ((log_fd = new_log_file(output, seg.time)) < 0)
+		    || (log_writer_open(&output->writer, log_fd, 0, 0, 0) < 0))
+		{
+		    perror(output->filename);
+		    exit(2);
+		}
+		checkpoint_opened(output->filename, output->writer.length);
+		retain_logs(output, seg.time);
+	    }
+	    if ((n = range_copy(output->writer.fd, &seg)) < 0)
+	    {
+		perror(output->filename);
+		exit(5);
+	    }
+	    output->writer.length += n;
+	    TRACE(TRACE_WRITE, output->number, n, output->writer.length, NULL);
+	}
+    }
+
+    /* Finish a last line that has no newline */
+
+    if (last_char != '\n')
+    {
+	for (output = outputs; output < outputs + n_outputs; output++)
+	{
+	    log_writer_write(&output->writer, "\n", 1);
+	}
+    }
+    range_close();
+    close_outputs(outputs, n_outputs);
+    return undated;
+}
+
+/* Split the lines of existing log files into the log files of the
+ * periods in which they were logged, as given by their Common Log
+ * Format timestamps.  Lines are written in runs of consecutive lines
+ * logged in the same second; a line without a valid timestamp is
+ * taken to have been logged at the same time as the line before it.
+ * The split starts at offset skip of inputs[first], after a line
+ * logged at run_time (or -1).
+ *
+ * Returns the number of lines that could not be dated.
+ */
+static long
+split_inputs(LOG_OUTPUT *outputs, int n_outputs, char **inputs, int n_inputs,
+	     int first, off_t skip, time_t run_time)
+{
+    const char	*data;
+    const char	*end;
+    const char	*run;
+    const char	*line;
+    const char	*eol;
+    char	*carry = NULL;
+    size_t	carry_len = 0;
+    size_t	carry_size = 0;
+    ssize_t	len;
+    time_t	line_time;
+    long	undated = 0;
+    off_t	since_mark = 0;
+    off_t	offset;
+    int		input;
+
+    if (input_open(inputs + first, n_inputs - first, 0, skip) < 0)
+    {
+	perror("input");
+	exit(1);
+    }
+    while ((len = input_next(&data)) > 0)
+    {
+	TRACE(TRACE_READ, -1, len, 0, NULL);
+	if (since_mark >= CHECKPOINT_BYTES)
+	{
+	    input = first + input_position(&offset);
+	    checkpoint_mark(outputs, n_outputs, inputs, input, offset - carry_len, run_time);
+	    since_mark = 0;
+	}
+	since_mark += len;
+	end  = data + len;
+	line = data;
+
+	/* Finish the line left incomplete at the end of the last
+	 * block, and write it out on its own.
+	 */
+	if (carry_len > 0)
+	{
+	    eol = memchr(data, '\n', len);
+	    line = eol ? eol + 1 : end;
+	    if (carry_len + (line - data) > carry_size)
+	    {
+		carry_size = 2 * (carry_len + (line - data));
+		if ((carry = realloc(carry, carry_size)) == NULL)
+		{
+		    perror("input");
+		    exit(1);
+		}
+	    }
+	    memcpy(carry + carry_len, data, line - data);
+	    carry_len += line - data;
+	    if (eol == NULL)
+	    {
+		continue;
+	    }
+	    if (parse_clf_time(carry, carry_len, &line_time) == 0)
+	    {
+		run_time = line_time;
+	    }
+	    if (run_time == -1)
+	    {
+		undated++;
+	    }
+	    else
+	    {
+		write_outputs(outputs, n_outputs, carry, carry_len, run_time, 0, 0);
+	    }
+	    carry_len = 0;
+	}
+
+	/* Write out the complete lines in the block in runs with
+	 * the same time.
+	 */
+	for (run = line; (eol = memchr(line, '\n', end - line)) != NULL; line = eol + 1)
+	{
+	    if (   (parse_clf_time(line, eol - line, &line_time) < 0)
+		|| (line_time == run_time))
+	    {
+		if (run_time == -1)
+		{
+		    undated++;
+		    run = eol + 1;
+		}
+		continue;
+	    }
+	    if (line > run)
+	    {
+		write_outputs(outputs, n_outputs, run, line - run, run_time, 0, 0);
+	    }
+	    run      = line;
+	    run_time = line_time;
+	}
+	if (line > run)
+	{
+	    write_outputs(outputs, n_outputs, run, line - run, run_time, 0, 0);
+	}
+
+	/* Keep any incomplete line until the next block */
+
+	if (line < end)
+	{
+	    carry_len = end - line;
+	    if (carry_len > carry_size)
+	    {
+		carry_size = 2 * carry_len;
+		if ((carry = realloc(carry, carry_size)) == NULL)
+		{
+		    perror("input");
+		    exit(1);
+		}
+	    }
+	    memcpy(carry, line, carry_len);
+	}
+    }
+    input_close();
+    free(carry);
+    write_outputs(outputs, n_outputs, "", 0, run_time, 1, 0);
+    close_outputs(outputs, n_outputs);
+    return undated;
+}
+
+/* Take an option (ch, with the argument arg) that describes the
+ * output of the next template, setting it in pending.
+ *
+ * Returns 1 if the option was taken, 0 if it does not describe an
+ * output, or -1 if its argument is invalid (after printing a message).
+ */
+static int
+output_option(LOG_OUTPUT *pending, int ch, char *arg, const char *prog)
+{
+    switch (ch)
+    {
+    case 'A':
+	if (   (strlen(arg) == 0) || (strlen(arg) > LISTEN_TAG_MAX)
+	    || (strpbrk(arg, " \n") != NULL))
+	{
+	    fprintf(stderr, "%s: invalid tag (%s)\n", prog, arg);
+	    return -1;
+	}
+	pending->tag = arg;
+	return 1;
+
+    case 'c':
+	pending->catalog = arg;
+	return 1;
+
+    case 'K':
+	pending->write_sum = 1;
+	return 1;
+
+    case 'T':
+	pending->stamp_format = arg;
+	return 1;
+
+    case 'H':
+	pending->linkname = arg;
+	pending->linktype = S_IFREG;
+	return 1;
+
+    case 'l':
+    case 'S':
+	pending->linkname = arg;
+#ifndef _WIN32
+	pending->linktype = S_IFLNK;
+#endif        
+	return 1;
+
+    case 'P':
+	pending->prevlinkname = arg;
+	return 1;
+
+    case 'd':
+	pending->period_delay_units = parse_timespec(arg, &pending->period_delay);
+	return 1;
+
+    case 'p':
+	pending->periodicity = parse_timespec(arg, &pending->period_multiple);
+	if (!valid_period(pending->periodicity, pending->period_multiple)) {
+	    fprintf(stderr, "%s: invalid explicit period specification (%s)\n", prog, arg);
+	    return -1;
+	}		
+	return 1;
+
+    case 'o':
+	pending->periodicity = ONCE_ONLY;
+	return 1;
+
+    case 'n':
+	pending->n_shards = atoi(arg);
+	if (pending->n_shards < 1)
+	{
+	    fprintf(stderr, "%s: invalid number of shards (%s)\n", prog, arg);
+	    return -1;
+	}
+	return 1;
+
+    case 'k':
+	pending->shard_key = atoi(arg);
+	if (pending->shard_key < 1)
+	{
+	    fprintf(stderr, "%s: invalid shard key field (%s)\n", prog, arg);
+	    return -1;
+	}
+	return 1;
+
+    case 'I':
+	{
+	    PERIODICITY	units;
+	    int		count;
+
+	    units = parse_timespec(arg, &count);
+	    if ((units != INVALID_PERIOD) && (units <= MONTHLY))
+	    {
+		pending->index_interval = count * period_seconds[units];
+	    }
+	    else if ((pending->index_bytes = parse_size(arg)) <= 0)
+	    {
+		fprintf(stderr, "%s: invalid index interval (%s)\n", prog, arg);
+		return -1;
+	    }
+	}
+	return 1;
+
+    case 'R':
+	if (arg[strspn(arg, "0123456789")] == '\0')
+	{
+	    if ((pending->retain_periods = atoi(arg)) <= 0)
+	    {
+		fprintf(stderr, "%s: invalid number of periods to retain (%s)\n", prog, arg);
+		return -1;
+	    }
+	}
+	else if ((pending->retain_age = parse_age(arg)) < 0)
+	{
+	    pending->retain_age = 0;
+	    if ((pending->retain_bytes = parse_size(arg)) <= 0)
+	    {
+		fprintf(stderr, "%s: invalid retention policy (%s)\n", prog, arg);
+		return -1;
+	    }
+	}
+	return 1;
+
+    case 'G':
+#if HAVE_ZLIB_H
+	pending->frame_size = parse_size(arg);
+	if (pending->frame_size <= 0)
+	{
+	    fprintf(stderr, "%s: invalid frame size (%s)\n", prog, arg);
+	    return -1;
+	}
+	return 1;
+#else
+	fprintf(stderr, "%s: compiled without support for compression\n", prog);
+	return -1;
+#endif
+
+    case 'L':
+	pending->max_size = parse_size(arg);
+	if (pending->max_size <= 0)
+	{
+	    fprintf(stderr, "%s: invalid size limit (%s)\n", prog, arg);
+	    return -1;
+	}
+	return 1;
+    }
+    return 0;
+}
+
+/* Give an output the output options that were given after its
+ * template.
+ */
+static void
+apply_options(LOG_OUTPUT *output, const LOG_OUTPUT *pending)
+{
+    if (pending->linkname)
+    {
+	output->linkname = pending->linkname;
+	output->linktype = pending->linktype;
+    }
+    if (pending->prevlinkname)
+    {
+	output->prevlinkname = pending->prevlinkname;
+    }
+    if (pending->periodicity != UNKNOWN)
+    {
+	output->periodicity     = pending->periodicity;
+	output->period_multiple = pending->period_multiple;
+    }
+    if (pending->period_delay_units != UNKNOWN)
+    {
+	output->period_delay_units = pending->period_delay_units;
+	output->period_delay       = pending->period_delay;
+    }
+    if (pending->max_size)
+    {
+	output->max_size = pending->max_size;
+    }
+    if (pending->n_shards > 1)
+    {
+	output->n_shards = pending->n_shards;
+    }
+    if (pending->shard_key)
+    {
+	output->shard_key = pending->shard_key;
+    }
+    if (pending->index_interval)
+    {
+	output->index_interval = pending->index_interval;
+    }
+    if (pending->index_bytes)
+    {
+	output->index_bytes = pending->index_bytes;
+    }
+    if (pending->frame_size)
+    {
+	output->frame_size = pending->frame_size;
+    }
+    if (pending->catalog)
+    {
+	output->catalog = pending->catalog;
+    }
+    if (pending->write_sum)
+    {
+	output->write_sum = 1;
+    }
+    if (pending->stamp_format)
+    {
+	output->stamp_format = pending->stamp_format;
+    }
+    if (pending->tag)
+    {
+	output->tag = pending->tag;
+    }
+    if (pending->retain_periods)
+    {
+	output->retain_periods = pending->retain_periods;
+    }
+    if (pending->retain_age)
+    {
+	output->retain_age = pending->retain_age;
+    }
+    if (pending->retain_bytes)
+    {
+	output->retain_bytes = pending->retain_bytes;
+    }
+}
+
+/* Check the options of an output and, unless the period was specified
+ * explicitly, determine the periodicity from its template.
+ *
+ * Returns 0, or -1 if the options cannot be used together (after
+ * printing a message).
+ */
+static int
+setup_output(LOG_OUTPUT *output, const char *prog)
+{
+    if (output->prevlinkname && output->linkname == NULL)
+    {
+	fprintf(stderr, "%s: a current log symlink is needed to mantain a symlink to the previous log\n", prog);
+	return -1;
+    }
+
+    if ((output->n_shards > 1) && !template_has_specifier(output->template, "{shard}"))
+    {
+	fprintf(stderr, "%s: sharding needs a %%{shard} specifier in the template (%s)\n",
+		prog, output->template);
+	return -1;
+    }
+
+    if (output->max_size && !template_has_specifier(output->template, "N"))
+    {
+	fprintf(stderr, "%s: a size limit needs a %%N specifier in the template (%s)\n",
+		prog, output->template);
+	return -1;
+    }
+
+    if (output->periodicity == UNKNOWN)
+    {
+	output->periodicity = determine_periodicity(output->template);
+    }
+
+    if (   (output->periodicity == ONCE_ONLY)
+	&& (output->retain_periods || output->retain_age || output->retain_bytes))
+    {
+	fprintf(stderr, "%s: a retention policy needs a rotation period (%s)\n",
+		prog, output->template);
+	return -1;
+    }
+
+    DEBUG(("periodicity = %d %s\n", output->period_multiple, periods[output->periodicity]));
+
+    if (output->period_delay) {
+	if (   (output->period_delay_units > output->periodicity)
+	    || (   output->period_delay_units == output->periodicity
+		&& abs(output->period_delay)  >= output->period_multiple)) {
+	    fprintf(stderr, "%s: period delay cannot be larger than the rollover period\n", prog);
+	    return -1;
+	}		
+	output->period_delay *= period_seconds[output->period_delay_units];
+    }
+
+    DEBUG(("Rotation period of \"%s\" is per %d %s\n", output->template,
+	   output->period_multiple, periods[output->periodicity]));
+
+    return 0;
+}
+
+/* Replace each sharded output by one output per shard.  The shards
+ * of a template are consecutive and the first of them holds the
+ * state used to split the input into lines.
+ *
+ * Returns the new outputs (the old array being freed if they are not
+ * the same), setting *pn_outputs to their number, or NULL if there is
+ * not enough memory.
+ */
+static LOG_OUTPUT *
+split_shards(LOG_OUTPUT *outputs, int *pn_outputs)
+{
+    LOG_OUTPUT	*files;
+    LOG_OUTPUT	*output;
+    int		n_files;
+    int		i;
+
+    for (n_files = 0, i = 0; i < *pn_outputs; i++)
+    {
+	n_files += outputs[i].n_shards;
+    }
+    if (n_files == *pn_outputs)
+    {
+	return outputs;
+    }
+    if ((files = calloc(n_files, sizeof (LOG_OUTPUT))) == NULL)
+    {
+	return NULL;
+    }
+    for (n_files = 0, output = outputs; output < outputs + *pn_outputs; output++)
+    {
+	for (i = 0; i < output->n_shards; i++)
+	{
+	    files[n_files] = *output;
+	    files[n_files].shard = i;
+	    if (output->n_shards > 1)
+	    {
+		files[n_files].shard_buf = malloc(2 * BUFSIZE);
+		if (i == 0)
+		{
+		    files[n_files].partial = malloc(2 * BUFSIZE);
+		}
+		if (   (files[n_files].shard_buf == NULL)
+		    || ((i == 0) && (files[n_files].partial == NULL)))
+		{
+		    return NULL;
+		}
+	    }
+	    n_files++;
+	}
+    }
+    free(outputs);
+    *pn_outputs = n_files;
+    return files;
+}
+
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_UN_H
+/* A pipe handed over by a cronolog-attach process (with --daemon),
+ * with the arguments it was given and the outputs of their templates.
+ */
+typedef struct attachment
+{
+    int			conn_fd;	/* connection from cronolog-attach (or -1) */
+    int			pipe_fd;	/* the pipe (-1 until it is received) */
+    dev_t		pipe_dev;	/* identity of the pipe */
+    ino_t		pipe_ino;
+    char		**argv;
+    LOG_OUTPUT		*outputs;
+    int			n_outputs;
+    struct attachment	*next;
+}
+ATTACHMENT;
+
+static ATTACHMENT	*attachments = NULL;
+static int		n_attached_outputs = 0;
+
+/* Set up the outputs of the templates and output options sent by a
+ * cronolog-attach process, which are taken as they are on the command
+ * line.  Other options are refused.
+ *
+ * Returns the outputs, setting *pn_outputs to their number, or NULL if
+ * the arguments are invalid (after printing a message).
+ */
+static LOG_OUTPUT *
+attachment_outputs(int argc, char **argv, int *pn_outputs, int coordinate)
+{
+    LOG_OUTPUT	*outputs;
+    LOG_OUTPUT	*output;
+    LOG_OUTPUT	pending;
+    int		n_outputs = 0;
+    int		pending_options = 0;
+    int		ch;
+    int		i;
+
+    if ((outputs = calloc(argc, sizeof (LOG_OUTPUT))) == NULL)
+    {
+	perror(argv[0]);
+	return NULL;
+    }
+    init_output(&pending);
+    optind = 0;
+    while ((ch = getopt_long(argc, argv, short_options, long_options, NULL)) != EOF)
+    {
+	if (ch == 1)
+	{
+	    pending.template = optarg;
+	    outputs[n_outputs++] = pending;
+	    init_output(&pending);
+	    pending_options = 0;
+	}
+	else if ((i = output_option(&pending, ch, optarg, argv[0])) > 0)
+	{
+	    pending_options++;
+	}
+	else
+	{
+	    if ((i == 0) && (ch != '?'))
+	    {
+		fprintf(stderr, "%s: only output options can be given (-%c)\n", argv[0], ch);
+	    }
+	    goto fail;
+	}
+    }
+    while (optind < argc)
+    {
+	init_output(&outputs[n_outputs]);
+	outputs[n_outputs++].template = argv[optind++];
+    }
+    if (n_outputs == 0)
+    {
+	fprintf(stderr, "%s: no template\n", argv[0]);
+	goto fail;
+    }
+    if (pending_options)
+    {
+	apply_options(&outputs[n_outputs - 1], &pending);
+    }
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (setup_output(output, argv[0]) < 0)
+	{
+	    goto fail;
+	}
+	if (output->catalog && (catalog_open(output) < 0))
+	{
+	    goto fail;
+	}
+    }
+    if ((outputs = split_shards(outputs, &n_outputs)) == NULL)
+    {
+	perror(argv[0]);
+	return NULL;
+    }
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	output->number = n_attached_outputs++;
+	spill_init(output);
+	if (coordinate)
+	{
+	    shared_attach(output);
+	}
+    }
+    *pn_outputs = n_outputs;
+    return outputs;
+
+ fail:
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (output->catalog_fd >= 0)
+	{
+	    close(output->catalog_fd);
+	}
+    }
+    free(outputs);
+    return NULL;
+}
+
+/* Take over the pipe of a cronolog-attach process once its request has
+ * arrived.  A pipe that is already being read (because the server has
+ * started a new cronolog-attach for the same pipe) is kept as it is,
+ * with the new connection.
+ *
+ * Returns 0, or -1 if the attachment is finished with.
+ */
+static int
+attach_pipe(ATTACHMENT *att, int epoll_fd, int coordinate)
+{
+    struct epoll_event	event;
+    struct stat		stat_buf;
+    ATTACHMENT		*old;
+    int			argc;
+    int			fd;
+
+    if ((argc = attach_receive(att->conn_fd, &fd, &att->argv)) < 0)
+    {
+	return (errno == EAGAIN) ? 0 : -1;
+    }
+    if (fstat(fd, &stat_buf) < 0)
+    {
+	close(fd);
+	attach_reply(att->conn_fd, 0);
+	return -1;
+    }
+    for (old = attachments; old; old = old->next)
+    {
+	if ((old->pipe_dev == stat_buf.st_dev) && (old->pipe_ino == stat_buf.st_ino))
+	{
+	    DEBUG(("Pipe %d handed over again\n", old->pipe_fd));
+	    close(fd);
+	    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, att->conn_fd, NULL);
+	    attach_reply(att->conn_fd, 1);
+	    if (old->conn_fd >= 0)
+	    {
+		close(old->conn_fd);
+	    }
+	    old->conn_fd = att->conn_fd;
+	    att->conn_fd = -1;
+	    return -1;
+	}
+    }
+    att->outputs = attachment_outputs(argc, att->argv, &att->n_outputs, coordinate);
+    memset(&event, 0, sizeof (event));
+    event.events   = EPOLLIN;
+    event.data.ptr = att;
+    if (   (att->outputs == NULL) || (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)
+	|| (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0))
+    {
+	close(fd);
+	attach_reply(att->conn_fd, 0);
+	return -1;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, att->conn_fd, NULL);
+    attach_reply(att->conn_fd, 1);
+    att->pipe_fd  = fd;
+    att->pipe_dev = stat_buf.st_dev;
+    att->pipe_ino = stat_buf.st_ino;
+    att->next     = attachments;
+    attachments   = att;
+    DEBUG(("Took over pipe %d for \"%s\"\n", fd, att->outputs->template));
+    return 0;
+}
+
+/* Write out the last data of an attachment, close its log files and
+ * free it, letting a cronolog-attach process started with --wait exit.
+ * The pipe is taken out of the epoll set explicitly, as it stays there
+ * while cronolog-attach still has it open.
+ */
+static void
+detach_pipe(ATTACHMENT *att, int epoll_fd)
+{
+    ATTACHMENT		**patt;
+    LOG_OUTPUT		*output;
+
+    if (att->pipe_fd >= 0)
+    {
+	DEBUG(("Pipe %d is finished\n", att->pipe_fd));
+	for (patt = &attachments; *patt; patt = &(*patt)->next)
+	{
+	    if (*patt == att)
+	    {
+		*patt = att->next;
+		break;
+	    }
+	}
+	write_outputs(att->outputs, att->n_outputs, "", 0, time(NULL), 1, 0);
+	close_outputs(att->outputs, att->n_outputs);
+	for (output = att->outputs; output < att->outputs + att->n_outputs; output++)
+	{
+	    shared_detach(output);
+	    if ((output->shard == 0) && (output->catalog_fd >= 0))
+	    {
+		close(output->catalog_fd);
+	    }
+	    free(output->shard_buf);
+	    free(output->partial);
+	    free(output->pool);
+	}
+	free(att->outputs);
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, att->pipe_fd, NULL);
+	close(att->pipe_fd);
+    }
+    if (att->conn_fd >= 0)
+    {
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, att->conn_fd, NULL);
+	close(att->conn_fd);
+    }
+    free(att->argv);
+    free(att);
+}
+
+/* Run as a daemon that takes over the pipes handed over by
+ * cronolog-attach processes on the socket path, watching them all
+ * with one epoll descriptor and writing the data read from each pipe
+ * (with a single buffer for all of them) to the log files of the
+ * templates given with it, until a termination signal.
+ */
+static void
+serve_attachments(const char *path, int coordinate, time_t time_offset)
+{
+    static char		buf[BUFSIZE];
+    struct epoll_event	events[LISTEN_EVENTS];
+    struct epoll_event	event;
+    ATTACHMENT		*att;
+    int			epoll_fd;
+    int			listen_sock;
+    int			n_events;
+    int			conn;
+    int			n;
+    int			i;
+
+    memset(&event, 0, sizeof (event));
+    event.events   = EPOLLIN;
+    event.data.ptr = NULL;
+    if (   ((epoll_fd = epoll_create(LISTEN_EVENTS)) < 0)
+	|| ((listen_sock = socket_listen(path, SOCK_SEQPACKET)) < 0)
+	|| (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_sock, &event) < 0))
+    {
+	perror(path);
+	exit(2);
+    }
+    DEBUG(("Waiting for pipes on \"%s\"\n", path));
+
+    for (;;)
+    {
+	n_events = epoll_wait(epoll_fd, events, LISTEN_EVENTS, -1);
+	for (i = 0; i < n_events; i++)
+	{
+	    if ((att = events[i].data.ptr) == NULL)
+	    {
+		/* New connections, each watched until its request
+		 * arrives
+		 */
+		while ((conn = accept(listen_sock, NULL, NULL)) >= 0)
+		{
+		    event.data.ptr = att = calloc(1, sizeof (ATTACHMENT));
+		    if ((att == NULL) || (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn, &event) < 0))
+		    {
+			close(conn);
+			free(att);
+			continue;
+		    }
+		    att->conn_fd = conn;
+		    att->pipe_fd = -1;
+		}
+	    }
+	    else if (att->pipe_fd < 0)
+	    {
+		if (attach_pipe(att, epoll_fd, coordinate) < 0)
+		{
+		    detach_pipe(att, epoll_fd);
+		}
+	    }
+	    else
+	    {
+		n = read(att->pipe_fd, buf, sizeof (buf));
+		if (n > 0)
+		{
+		    TRACE(TRACE_READ, -1, n, 0, NULL);
+		    write_outputs(att->outputs, att->n_outputs, buf, n,
+				  time(NULL) + time_offset, 0, 0);
+		}
+		else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+		{
+		    detach_pipe(att, epoll_fd);
+		}
+	    }
+	}
+	if (report_signal)
+	{
+	    report_signal = 0;
+	    report_latency();
+	}
+	if (terminate_signal)
+	{
+	    while (attachments)
+	    {
+		detach_pipe(attachments, epoll_fd);
+	    }
+	    close(listen_sock);
+	    unlink(path);
+	    if (latency_file)
+	    {
+		report_latency();
+	    }
+	    signal(terminate_signal, SIG_DFL);
+	    raise(terminate_signal);
+	    exit(3);
+	}
+    }
+}
+#endif
+
 /* Main function.
  */
 int
 main(int argc, char **argv)
 {
-    PERIODICITY	periodicity = UNKNOWN;
-    PERIODICITY	period_delay_units = UNKNOWN;
-    int		period_multiple = 1;
-    int		period_delay  = 0;
+    LOG_OUTPUT	*outputs;
+    LOG_OUTPUT	*output;
+    LOG_OUTPUT	pending;
+    int		n_outputs = 0;
+    int		pending_options = 0;
     int		use_american_date_formats = 0;
     char 	read_buf[BUFSIZE];
     char 	tzbuf[BUFSIZE];
-    char	filename[MAX_PATH];
     char	*start_time = NULL;
-    char	*template;
-    char	*linkname = NULL;
-    char	*prevlinkname = NULL;
-    mode_t	linktype = 0;
+    char	*query_from = NULL;
+    char	*query_to = NULL;
+    char	*journal_file = NULL;
+    char	**input_files;
+    int		n_input_files = 0;
+    int		merge = 0;
+    int		jobs = 1;
+    char	*resume_file = NULL;
+    char	*daemon_socket = NULL;
+    int		stdin_open = 1;
+    int		mid_line = 0;
+    int		framed = 0;
+    int		clean_close = 0;
+    char	*trace_file = NULL;
+    int		coordinate = 0;
+    int		query = 0;
     int 	n_bytes_read;
     int		ch;
     time_t	time_now;
     time_t	time_offset = 0;
-    time_t	next_period = 0;
-    int 	log_fd = -1;
+    off_t	position;
+    off_t	input_length = 0;
+    unsigned long long read_done = 0;
+    unsigned long long held_since = 0;
+    int		i;
+
+    /* There cannot be more templates than arguments */
+
+    outputs = calloc(argc, sizeof (LOG_OUTPUT));
+    if (outputs == NULL)
+    {
+	perror(argv[0]);
+	exit(1);
+    }
+    input_files = calloc(argc, sizeof (char *));
+    if (input_files == NULL)
+    {
+	perror(argv[0]);
+	exit(1);
+    }
+    init_output(&pending);
 
 #ifndef _WIN32
     while ((ch = getopt_long(argc, argv, short_options, long_options, NULL)) != EOF)
@@ -176,6 +2203,16 @@ main(int argc, char **argv)
     {
 	switch (ch)
 	{
+	case 1:
+	    /* A template: it takes the output options seen since
+	     * the previous template.
+	     */
+	    pending.template = optarg;
+	    outputs[n_outputs++] = pending;
+	    init_output(&pending);
+	    pending_options = 0;
+	    break;
+
 	case 'a':
 	    use_american_date_formats = 1;
 	    break;
@@ -188,54 +2225,101 @@ main(int argc, char **argv)
 	    start_time = optarg;
 	    break;
 
-	case 'z':
-	    sprintf(tzbuf, "TZ=%s", optarg);
-	    putenv(tzbuf);
+	case 'q':
+	    query = 1;
 	    break;
 
-	case 'H':
-	    linkname = optarg;
-	    linktype = S_IFREG;
+	case 'i':
+	    input_files[n_input_files++] = optarg;
 	    break;
 
-	case 'l':
-	case 'S':
-	    linkname = optarg;
-#ifndef _WIN32
-	    linktype = S_IFLNK;
-#endif        
+	case 'g':
+	    merge = 1;
 	    break;
-	    
-	case 'P':
-	    if (linkname == NULL)
+
+	case 'j':
+	    jobs = atoi(optarg);
+	    if (jobs < 1)
 	    {
-		fprintf(stderr, "A current log symlink is needed to mantain a symlink to the previous log\n", argv[0]);
+		fprintf(stderr, "%s: invalid number of jobs: %s\n", argv[0], optarg);
 		exit(1);
 	    }
-	    prevlinkname = optarg;
 	    break;
-	    
 
-	case 'd':
-	    period_delay_units = parse_timespec(optarg, &period_delay);
+	case 'r':
+	    resume_file = optarg;
 	    break;
 
-	case 'p':
-	    periodicity = parse_timespec(optarg, &period_multiple);
-	    if (   (periodicity == INVALID_PERIOD)
-		|| (periodicity == PER_SECOND) && (60 % period_multiple)
-		|| (periodicity == PER_MINUTE) && (60 % period_multiple)
-		|| (periodicity == HOURLY)     && (24 % period_multiple)
-		|| (periodicity == DAILY)      && (period_multiple > 365)
-		|| (periodicity == WEEKLY)     && (period_multiple > 52)
-		|| (periodicity == MONTHLY)    && (12 % period_multiple)) {
-		fprintf(stderr, "%s: invalid explicit period specification (%s)\n", argv[0], start_time);
-		exit(1);
-	    }		
+	case 'b':
+#if HAVE_SHM_OPEN && HAVE_POLL_H
+	    ring_name = optarg;
+#else
+	    fprintf(stderr, "%s: compiled without support for --ring\n", argv[0]);
+	    exit(1);
+#endif
+	    break;
+
+	case 'u':
+	case 'U':
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_UN_H && HAVE_POLL_H
+	    if (ch == 'u')
+	    {
+		listen_stream = optarg;
+	    }
+	    else
+	    {
+		listen_dgram = optarg;
+	    }
+#else
+	    fprintf(stderr, "%s: compiled without support for --listen\n", argv[0]);
+	    exit(1);
+#endif
+	    break;
+
+	case 'f':
+	    query_from = optarg;
+	    break;
+
+	case 't':
+	    query_to = optarg;
+	    break;
+
+	case 'z':
+	    sprintf(tzbuf, "TZ=%s", optarg);
+	    putenv(tzbuf);
+	    break;
+
+	case 'm':
+	    use_mmap = 1;
+	    break;
+	    
+	case 'F':
+	    spill_dir = optarg;
+	    break;
+	    
+	case 'J':
+	    journal_file = optarg;
+	    break;
+	    
+	case 'C':
+	    coordinate = 1;
+	    break;
+	    
+	case 'D':
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_UN_H
+	    daemon_socket = optarg;
+#else
+	    fprintf(stderr, "%s: compiled without support for --daemon\n", argv[0]);
+	    exit(1);
+#endif
 	    break;
 	    
-	case 'o':
-	    periodicity = ONCE_ONLY;
+	case 'X':
+	    trace_file = optarg;
+	    break;
+	    
+	case 'M':
+	    latency_file = optarg;
 	    break;
 	    
 	case 'x':
@@ -257,17 +2341,78 @@ main(int argc, char **argv)
 	case '?':
 	    fprintf(stderr, USAGE_MSG, argv[0]);
 	    exit(1);
+
+	default:
+	    /* Options that describe the output of the next template */
+
+	    if ((i = output_option(&pending, ch, optarg, argv[0])) < 0)
+	    {
+		exit(1);
+	    }
+	    if (i == 0)
+	    {
+		fprintf(stderr, USAGE_MSG, argv[0]);
+		exit(1);
+	    }
+	    pending_options++;
+	    break;
 	}
     }
 
-    if ((argc - optind) != 1)
+    /* Any templates after "--" are taken without options */
+
+    while (optind < argc)
+    {
+	init_output(&outputs[n_outputs]);
+	outputs[n_outputs++].template = argv[optind++];
+    }
+    if (daemon_socket)
+    {
+	if (   n_outputs || pending_options || query || n_input_files || journal_file
+	    || ring_name || listen_stream || listen_dgram)
+	{
+	    fprintf(stderr, "%s: --daemon cannot be used with templates, --query, --input,"
+		    " --journal, --ring or --listen\n", argv[0]);
+	    exit(1);
+	}
+    }
+    else if (n_outputs == 0)
     {
 	fprintf(stderr, USAGE_MSG, argv[0]);
 	exit(1);
     }
 
+    /* Output options given after the last template apply to it, so
+     * that "cronolog TEMPLATE -S LINK" works as it always has.
+     */
+    if (pending_options)
+    {
+	apply_options(&outputs[n_outputs - 1], &pending);
+    }
+
     DEBUG((VERSION_MSG "\n"));
 
+    if (trace_file && (trace_open(trace_file) < 0))
+    {
+	perror(trace_file);
+	exit(1);
+    }
+
+    if (latency_file)
+    {
+	latency_since = time(NULL);
+#ifndef _WIN32
+	{
+	    struct sigaction	sa;
+
+	    memset(&sa, 0, sizeof (sa));
+	    sa.sa_handler = handle_report;
+	    sigemptyset(&sa.sa_mask);
+	    sigaction(SIGUSR2, &sa, NULL);
+	}
+#endif
+    }
+
     if (start_time)
     {
 	time_now = parse_time(start_time, use_american_date_formats);
@@ -280,84 +2425,354 @@ main(int argc, char **argv)
 	DEBUG(("Using offset of %d seconds from real time\n", time_offset));
     }
 
-    /* The template should be the only argument.
-     * Unless the -o option was specified, determine the periodicity.
+    /* Check the options of each output and determine its period */
+
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (setup_output(output, argv[0]) < 0)
+	{
+	    exit(1);
+	}
+
+	if (output->catalog && !query && (catalog_open(output) < 0))
+	{
+	    exit(2);
+	}
+    }
+
+    /* In query mode print the lines logged in the time range from the
+     * existing log files rather than reading the input.
      */
-    
-    template = argv[optind];
-    if (periodicity == UNKNOWN)
+    if (query)
+    {
+	time_t	from;
+	time_t	to = time(NULL);
+
+	if (   (query_from == NULL)
+	    || ((from = parse_time(query_from, use_american_date_formats)) == -1))
+	{
+	    fprintf(stderr, "%s: --query needs a valid --from time\n", argv[0]);
+	    exit(1);
+	}
+	if (query_to && ((to = parse_time(query_to, use_american_date_formats)) == -1))
+	{
+	    fprintf(stderr, "%s: invalid --to time (%s)\n", argv[0], query_to);
+	    exit(1);
+	}
+	for (output = outputs; output < outputs + n_outputs; output++)
+	{
+	    query_logs(output, from, to);
+	}
+	exit(0);
+    }
+
+    /* Replace each sharded output by one output per shard */
+
+    if ((outputs = split_shards(outputs, &n_outputs)) == NULL)
+    {
+	perror(argv[0]);
+	exit(1);
+    }
+
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	output->number = output - outputs;
+	spill_init(output);
+	if (coordinate)
+	{
+	    shared_attach(output);
+	}
+    }
+
+    if (use_mmap)
     {
-	periodicity = determine_periodicity(template);
+	log_file_flags = O_RDWR|O_CREAT;
     }
 
+    /* As a daemon, take over the pipes of cronolog-attach processes */
 
-    DEBUG(("periodicity = %d %s\n", period_multiple, periods[periodicity]));
+#if HAVE_SYS_EPOLL_H && HAVE_SYS_UN_H
+    if (daemon_socket)
+    {
+	catch_termination();
+	serve_attachments(daemon_socket, coordinate, time_offset);
+    }
+#endif
 
-    if (period_delay) {
-	if (   (period_delay_units > periodicity)
-	    || (   period_delay_units == periodicity
-		&& abs(period_delay)  >= period_multiple)) {
-	    fprintf(stderr, "%s: period delay cannot be larger than the rollover period\n", argv[0], start_time);
+    if (n_input_files && journal_file)
+    {
+	fprintf(stderr, "%s: --input cannot be used with --journal\n", argv[0]);
+	exit(1);
+    }
+    if (ring_name && (n_input_files || journal_file))
+    {
+	fprintf(stderr, "%s: --ring cannot be used with --input or --journal\n", argv[0]);
+	exit(1);
+    }
+    if ((listen_stream || listen_dgram) && (n_input_files || journal_file))
+    {
+	fprintf(stderr, "%s: --listen cannot be used with --input or --journal\n", argv[0]);
+	exit(1);
+    }
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (output->tag && !listen_stream && !listen_dgram)
+	{
+	    fprintf(stderr, "%s: --tag needs --listen or --listen-dgram\n", argv[0]);
 	    exit(1);
-	}		
-	period_delay *= period_seconds[period_delay_units];
+	}
+    }
+    if (resume_file)
+    {
+	if ((n_input_files == 0) || merge)
+	{
+	    fprintf(stderr, "%s: --resume needs --input and cannot be used with --merge\n", argv[0]);
+	    exit(1);
+	}
+	for (output = outputs; output < outputs + n_outputs; output++)
+	{
+	    if (   output->index_interval || output->index_bytes || output->frame_size
+		|| output->catalog || output->write_sum || spill_dir)
+	    {
+		fprintf(stderr, "%s: --resume cannot be used with --index, --gzip-frames,"
+			" --catalog, --checksum or --fallback\n", argv[0]);
+		exit(1);
+	    }
+	}
+    }
+
+    /* Write out the data left in the journal by the last cronolog
+     * process, then empty the journal.
+     */
+    if (journal_file)
+    {
+	for (i = 0; i < n_outputs; i++)
+	{
+	    outputs[i].journal_slot = i;
+	}
+	if (journal_open(journal_file, n_outputs) < 0)
+	{
+	    exit(2);
+	}
+	replay_journal(outputs, n_outputs);
+    }
+
+
+    /* Split or merge existing log files rather than standard input */
+
+    if (n_input_files > 0)
+    {
+	long	undated;
+	long	n;
+	int	first = 0;
+	off_t	skip = 0;
+	time_t	skip_time = -1;
+
+	if (resume_file)
+	{
+	    if (checkpoint_open(resume_file, input_files, n_input_files,
+				&first, &skip, &skip_time) < 0)
+	    {
+		exit(2);
+	    }
+	}
+	if (merge)
+	{
+	    undated = merge_inputs(outputs, n_outputs, input_files, n_input_files);
+	}
+	else if ((jobs > 1) && can_copy_ranges(outputs, n_outputs))
+	{
+	    log_file_flags = O_WRONLY|O_CREAT;
+	    for (undated = 0, i = first; i < n_input_files; i++)
+	    {
+		if ((n = copy_ranges(outputs, n_outputs, input_files, i, jobs, skip, skip_time)) < 0)
+		{
+		    n = split_inputs(outputs, n_outputs, input_files, i + 1, i, skip, skip_time);
+		}
+		undated  += n;
+		skip      = 0;
+		skip_time = -1;
+	    }
+	}
+	else
+	{
+	    undated = split_inputs(outputs, n_outputs, input_files, n_input_files,
+				   first, skip, skip_time);
+	}
+	checkpoint_done();
+	if (undated > 0)
+	{
+	    fprintf(stderr, "%s: skipped %ld lines without a time\n", argv[0], undated);
+	}
+	if (latency_file)
+	{
+	    report_latency();
+	}
+	exit(0);
     }
 
-    DEBUG(("Rotation period is per %d %s\n", period_multiple, periods[periodicity]));
+    /* Take records from the ring between the lines of the input */
+
+    if (ring_name)
+    {
+	if (ring_open(ring_name) < 0)
+	{
+	    perror(ring_name);
+	    exit(2);
+	}
+	ring_fd = ring_notify_fd();
+    }
+    if (listen_stream || listen_dgram)
+    {
+	if ((listen_fd = listen_open(listen_stream, listen_dgram)) < 0)
+	{
+	    perror(listen_stream ? listen_stream : listen_dgram);
+	    exit(2);
+	}
+    }
 
+    /* Catch the termination signals if the log files must be closed
+     * cleanly (or cronolog does not stop at the end of its input).
+     * Compressed files are also waited on, to finish idle frames.
+     */
+    for (output = outputs; output < outputs + n_outputs; output++)
+    {
+	if (output->frame_size)
+	{
+	    framed = 1;
+	}
+	if (output->catalog || output->write_sum)
+	{
+	    clean_close = 1;
+	}
+    }
+#ifndef _WIN32
+    if (use_mmap || spill_dir || ring_name || (listen_fd >= 0) || framed || clean_close)
+    {
+	catch_termination();
+    }
+#endif
 
     /* Loop, waiting for data on standard input */
 
     for (;;)
     {
 	/* Read a buffer's worth of log file data, exiting on errors
-	 * or end of file.
+	 * or end of file.  With a ring, sockets or compressed files, the
+	 * input is only read once there is some, the ring and the
+	 * sockets being drained and idle frames finished meanwhile.
 	 */
-	n_bytes_read = read(0, read_buf, sizeof read_buf);
-	if (n_bytes_read == 0)
+	if (   !(ring_name || (listen_fd >= 0) || framed)
+	    || wait_for_input(outputs, n_outputs, stdin_open, mid_line, time_offset))
 	{
-	    exit(3);
+	    n_bytes_read = read(0, read_buf, sizeof read_buf);
 	}
-	if (errno == EINTR)
+	else
 	{
-	    continue;
+	    n_bytes_read = -1;
+	    errno        = EINTR;
+	}
+	if (latency_file)
+	{
+	    read_done = hist_now();
 	}
-	else if (n_bytes_read < 0)
+	if ((n_bytes_read < 0) && (errno != EINTR))
 	{
+	    write_outputs(outputs, n_outputs, read_buf, 0, time(NULL) + time_offset, 1,
+			  journal_position());
+	    close_outputs(outputs, n_outputs);
+	    journal_reset();
 	    exit(4);
 	}
 
 	time_now = time(NULL) + time_offset;
-	
-	/* If the current period has finished and there is a log file
-	 * open, close the log file
+
+	/* Each output is rotated independently according to its own
+	 * period.
 	 */
-	if ((time_now >= next_period) && (log_fd >= 0))
+	PROBE1(read__done, n_bytes_read);
+	if (n_bytes_read > 0)
 	{
-	    close(log_fd);
-	    log_fd = -1;
+	    input_length += n_bytes_read;
+	    TRACE(TRACE_READ, -1, n_bytes_read, input_length, NULL);
+	    position = journal_position();
+	    if (journal_append(read_buf, n_bytes_read, time_now) < 0)
+	    {
+		sync_outputs(outputs, n_outputs);
+		mark_outputs(outputs, n_outputs, position);
+		journal_commit();
+		if (journal_append(read_buf, n_bytes_read, time_now) < 0)
+		{
+		    DEBUG(("Journal is full\n"));
+		}
+	    }
+	    PROBE1(write__start, n_bytes_read);
+	    route_outputs(outputs, n_outputs, NULL, read_buf, n_bytes_read, time_now, position);
+	    PROBE1(write__done, n_bytes_read);
+	    mid_line = (read_buf[n_bytes_read - 1] != '\n');
+	    mark_outputs(outputs, n_outputs, journal_position());
+	    journal_commit();
+	    if (latency_file)
+	    {
+		hist_record(&write_latency, hist_now() - (held_since ? held_since : read_done));
+		for (held_since = 0, i = 0; i < n_outputs; i++)
+		{
+		    if (outputs[i].partial_len > 0)
+		    {
+			held_since = read_done;
+		    }
+		}
+	    }
 	}
-	
-	/* If there is no log file open then open a new one.
-	 */
-	if (log_fd < 0)
+#ifndef _WIN32
+
+	if (report_signal)
 	{
-	    log_fd = new_log_file(template, linkname, linktype, prevlinkname,
-				  periodicity, period_multiple, period_delay,
-				  filename, sizeof (filename), time_now, &next_period);
+	    report_signal = 0;
+	    report_latency();
 	}
+#endif
 
-	DEBUG(("%s (%d): wrote message; next period starts at %s (%d) in %d secs\n",
-	       timestamp(time_now), time_now, 
-	       timestamp(next_period), next_period,
-	       next_period - time_now));
+	/* With a ring or sockets, end of file only finishes the last
+	 * line of the input; they are drained until a termination
+	 * signal.
+	 */
+	if ((n_bytes_read == 0) && (ring_name || (listen_fd >= 0)))
+	{
+	    if (mid_line)
+	    {
+		route_outputs(outputs, n_outputs, NULL, "\n", 1, time_now, 0);
+		mid_line = 0;
+	    }
+	    stdin_open = 0;
+	}
 
-	/* Write out the log data to the current log file.
+	/* At end of file or on a termination signal, write out any
+	 * incomplete lines held back for sharded outputs and close the
+	 * log files.
 	 */
-	if (write(log_fd, read_buf, n_bytes_read) != n_bytes_read)
+#ifndef _WIN32
+	if (((n_bytes_read == 0) && !ring_name && (listen_fd < 0)) || terminate_signal)
+#else
+	if (n_bytes_read == 0)
+#endif
 	{
-	    perror(filename);
-	    exit(5);
+	    write_outputs(outputs, n_outputs, read_buf, 0, time_now, 1, journal_position());
+	    close_outputs(outputs, n_outputs);
+	    journal_reset();
+	    listen_close();
+	    if (latency_file)
+	    {
+		report_latency();
+	    }
+#ifndef _WIN32
+	    if (terminate_signal)
+	    {
+		signal(terminate_signal, SIG_DFL);
+		raise(terminate_signal);
+	    }
+#endif
+	    exit(3);
 	}
     }
 
@@ -0,0 +1,187 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronolog.h -- interface to the cronolog writer library (libcronolog)
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * The library lets a program write its logs straight to log files
+ * named and rotated by a cronolog template, without piping them to a
+ * cronolog process:
+ *
+ *	CRONOLOG_OPTIONS	opts = CRONOLOG_DEFAULT_OPTIONS;
+ *	CRONOLOG		*log;
+ *
+ *	opts.symlink = "/www/logs/access.log";
+ *	log = cronolog_open("/www/logs/%Y/%m/%d/access.log", &opts);
+ *	...
+ *	cronolog_write(log, line, len);
+ *	...
+ *	cronolog_close(log);
+ *
+ * The log files are named, created and linked exactly as by cronolog
+ * with the same options.  Each write goes to the log file of the
+ * period in which it is made and is written with a single system
+ * call, so whole lines written by different threads are not mixed.
+ * A handle may be shared by any number of threads.
+ *
+ * Programs that must never wait for the disk can instead append their
+ * lines to a shared memory ring drained by a cronolog process (see
+ * cronolog_ring_attach() below).
+ *
+ * Link with -lcronolog (and -lz -lpthread -lrt where the library was
+ * built with them).
+ */
+
+#ifndef _CRONOLOG_H_
+#define _CRONOLOG_H_
+
+#include <sys/types.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#else
+struct iovec
+{
+    void	*iov_base;
+    size_t	iov_len;
+};
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A log file template being written to */
+
+typedef struct cronolog CRONOLOG;
+
+/* Options of a template, as for the cronolog options of the same
+ * names (NULL or 0 for the defaults).
+ */
+
+typedef struct
+{
+    const char	*period;	/* rotation period, e.g. "15 minutes" */
+    const char	*delay;		/* rotation delay, e.g. "5 minutes" */
+    off_t	size_limit;	/* also rotate at this size (the template needs %N) */
+    const char	*symlink;	/* symbolic link to the current log file */
+    const char	*prev_symlink;	/* symbolic link to the previous log file */
+    const char	*hardlink;	/* hard link to the current log file */
+    int		coordinate;	/* share period state with other processes */
+}
+CRONOLOG_OPTIONS;
+
+#define CRONOLOG_DEFAULT_OPTIONS	{ 0, 0, 0, 0, 0, 0, 0 }
+
+/* Open a log file template; returns NULL on error (with errno set). */
+
+CRONOLOG	*cronolog_open(const char *name_template, const CRONOLOG_OPTIONS *opts);
+
+/* Write data to the current log file of a template, rotating it
+ * first if its period has finished or it would go past its size
+ * limit; returns the number of bytes written or -1 on error (with
+ * errno set).
+ */
+
+ssize_t		cronolog_write(CRONOLOG *log, const char *buf, size_t len);
+ssize_t		cronolog_writev(CRONOLOG *log, const struct iovec *iov, int iovcnt);
+
+/* Copy the name of the current log file (or "" if there is none) */
+
+void		cronolog_filename(CRONOLOG *log, char *buf, size_t buflen);
+
+/* Close the log file and free the handle */
+
+void		cronolog_close(CRONOLOG *log);
+
+
+/* A shared memory ring drained by a cronolog process started with
+ * "--ring=name", for producers that should not wait for cronolog.
+ * Each record should be one or more whole lines (cronolog adds a
+ * newline to a record that does not end with one).
+ */
+
+typedef struct cronolog_ring CRONOLOG_RING;
+
+/* Attach to a ring; returns NULL on error (with errno set: ENOENT if
+ * cronolog has not created the ring).
+ */
+
+CRONOLOG_RING	*cronolog_ring_attach(const char *name);
+
+/* Append a record to a ring; returns 0, or -1 on error (with errno
+ * set: EAGAIN if the ring is full, EMSGSIZE if the record is too
+ * large).
+ */
+
+int		cronolog_ring_write(CRONOLOG_RING *ring, const char *buf, size_t len);
+
+/* Detach from a ring */
+
+void		cronolog_ring_detach(CRONOLOG_RING *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,589 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoquery -- time-range queries over log files written by cronolog
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * "cronolog --query --from=TIME --to=TIME TEMPLATE" prints the log
+ * lines written between two times.  Rather than searching directories
+ * the names of the files covering the range are generated from the
+ * template with the same period arithmetic that cronolog uses to
+ * create them.  If a file has a time index (see cronoindex.c) only
+ * the part of it between the index records bracketing the range is
+ * read; for files written as gzip frames this means only the frames
+ * covering the range are decompressed.
+ *
+ * Lines with a Common Log Format timestamp ("[dd/Mon/yyyy:HH:MM:SS
+ * +zzzz]") are filtered on that timestamp; other lines are printed if
+ * they fall within the part of the file selected by the index (all of
+ * the file if it has no index).
+ *
+ * Files are read in parallel by up to QUERY_THREADS threads, each
+ * filtering into a temporary file in which every line is preceded by
+ * its time: the CLF timestamp, else the time of the index record
+ * covering the line, else the time of the line before it.  The files
+ * of each shard are printed in sequence order and, if the template is
+ * sharded, the shards of each period are merged on these times so
+ * that the output is in time order.
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+
+/* A record of a time index */
+
+typedef struct
+{
+    time_t	time;
+    off_t	offset;
+}
+QUERY_MARK;
+
+/* A file to be searched and the part of it to read */
+
+typedef struct
+{
+    char	filename[MAX_PATH];
+    int		shard;
+    time_t	from;
+    time_t	to;
+    off_t	start;		/* offset at which to start reading */
+    off_t	end;		/* offset at which to stop (-1 for end of file) */
+    QUERY_MARK	*marks;		/* records of the time index */
+    int		n_marks;
+    int		mark;		/* record covering the data being filtered */
+    off_t	position;	/* offset of the data being filtered */
+    int		inflating;	/* position is that of a gzip frame */
+    time_t	last;		/* time of the last line */
+    FILE	*out;		/* matching lines */
+    char	line[BUFSIZE];	/* incomplete line carried between blocks */
+    size_t	line_len;
+    time_t	line_time;	/* time of the line in line (when merging) */
+}
+QUERY_FILE;
+
+/* The header of a line in the temporary file of a search */
+
+typedef struct
+{
+    time_t	time;
+    size_t	len;
+}
+QUERY_LINE;
+
+
+/* Read the time index of a log file (if there is one) and narrow the
+ * part of the file to be read to that between the last record at or
+ * before the start of the range and the first record after the end
+ * of the range (allowing QUERY_SLACK for lines being written some
+ * time after their timestamp).  The records are kept to give a time
+ * to the lines without a timestamp.
+ */
+static void
+query_index(QUERY_FILE *qf)
+{
+    char	indexname[MAX_PATH];
+    FILE	*fp;
+    QUERY_MARK	*marks;
+    int		n_alloc = 0;
+    long	t;
+    long	offset;
+
+    qf->start   = 0;
+    qf->end     = -1;
+    qf->marks   = NULL;
+    qf->n_marks = 0;
+    qf->mark    = 0;
+    if (   (index_filename(qf->filename, indexname, sizeof (indexname)) < 0)
+	|| ((fp = fopen(indexname, "r")) == NULL))
+    {
+	return;
+    }
+    while (fscanf(fp, "%ld %ld\n", &t, &offset) == 2)
+    {
+	if (qf->n_marks == n_alloc)
+	{
+	    n_alloc = n_alloc ? 2 * n_alloc : 64;
+	    if ((marks = realloc(qf->marks, n_alloc * sizeof (QUERY_MARK))) == NULL)
+	    {
+		break;
+	    }
+	    qf->marks = marks;
+	}
+	qf->marks[qf->n_marks].time   = t;
+	qf->marks[qf->n_marks].offset = offset;
+	qf->n_marks++;
+	if (t <= qf->from)
+	{
+	    qf->start = offset;
+	}
+	else if (t > qf->to + QUERY_SLACK)
+	{
+	    qf->end = offset;
+	    break;
+	}
+    }
+    fclose(fp);
+    DEBUG(("\"%s\": reading from offset %ld to %ld\n", qf->filename,
+	   (long)qf->start, (long)qf->end));
+}
+
+/* Return the time of the index record covering the data being
+ * filtered: the last one at or before its position.
+ */
+static time_t
+query_mark(QUERY_FILE *qf)
+{
+    while (   (qf->mark + 1 < qf->n_marks)
+	   && (qf->marks[qf->mark + 1].offset <= qf->position))
+    {
+	qf->mark++;
+    }
+    return qf->marks[qf->mark].time;
+}
+
+/* Keep a line if it falls within the time range, preceded by its time.
+ */
+static void
+query_line(QUERY_FILE *qf, const char *line, size_t len)
+{
+    QUERY_LINE	header;
+    time_t	t;
+
+    if (parse_clf_time(line, len, &t) == 0)
+    {
+	if ((t < qf->from) || (t > qf->to))
+	{
+	    qf->last = t;
+	    return;
+	}
+    }
+    else if (qf->n_marks > 0)
+    {
+	t = query_mark(qf);
+    }
+    else
+    {
+	t = qf->last;
+    }
+    qf->last    = t;
+    header.time = t;
+    header.len  = len;
+    fwrite(&header, sizeof (header), 1, qf->out);
+    fwrite(line, 1, len, qf->out);
+}
+
+/* Split a block of data into lines and filter them.  A line longer
+ * than the carry buffer is treated as several lines.
+ */
+static void
+query_block(QUERY_FILE *qf, const char *data, size_t len)
+{
+    const char	*nl;
+    size_t	n;
+
+    while (len > 0)
+    {
+	nl = memchr(data, '\n', len);
+	n  = nl ? (size_t)(nl - data) + 1 : len;
+	if ((qf->line_len == 0) && nl)
+	{
+	    query_line(qf, data, n);
+	}
+	else
+	{
+	    if (qf->line_len + n > sizeof (qf->line))
+	    {
+		query_line(qf, qf->line, qf->line_len);
+		qf->line_len = 0;
+	    }
+	    memcpy(qf->line + qf->line_len, data, n);
+	    qf->line_len += n;
+	    if (nl)
+	    {
+		query_line(qf, qf->line, qf->line_len);
+		qf->line_len = 0;
+	    }
+	}
+	if (!qf->inflating)
+	{
+	    qf->position += n;
+	}
+	data += n;
+	len  -= n;
+    }
+}
+
+/* Search one file, writing the matching lines to a temporary file.
+ */
+static void *
+query_file(void *arg)
+{
+    QUERY_FILE		*qf = (QUERY_FILE *)arg;
+    unsigned char	buf[BUFSIZE];
+    off_t		offset;
+    ssize_t		n;
+    int			fd;
+
+    qf->last      = 0;
+    qf->inflating = 0;
+    if ((fd = open(qf->filename, O_RDONLY)) < 0)
+    {
+	return NULL;
+    }
+    query_index(qf);
+    offset = qf->position = lseek(fd, qf->start, SEEK_SET);
+    n = read(fd, buf, sizeof (buf));
+
+#if HAVE_ZLIB_H
+    if ((n >= 2) && (buf[0] == 0x1f) && (buf[1] == 0x8b))
+    {
+	/* gzip frames: inflate from the first frame needed, starting a
+	 * new stream at the start of each frame.  The lines inflated are
+	 * in the frame of the last byte consumed. */
+
+	unsigned char	out[BUFSIZE];
+	z_stream	zs;
+	int		rc = Z_OK;
+
+	qf->inflating = 1;
+	memset(&zs, 0, sizeof (zs));
+	inflateInit2(&zs, 15 + 16);
+	while (n > 0)
+	{
+	    if ((qf->end >= 0) && (offset + n > qf->end))
+	    {
+		n = qf->end - offset;
+	    }
+	    offset += n;
+	    zs.next_in  = buf;
+	    zs.avail_in = n;
+	    do
+	    {
+		zs.next_out  = out;
+		zs.avail_out = sizeof (out);
+		rc = inflate(&zs, Z_NO_FLUSH);
+		qf->position = offset - zs.avail_in - 1;
+		query_block(qf, (char *)out, sizeof (out) - zs.avail_out);
+		if (rc == Z_STREAM_END)
+		{
+		    inflateReset(&zs);
+		}
+		else if (rc == Z_BUF_ERROR)
+		{
+		    rc = Z_OK;		/* needs more input */
+		    break;
+		}
+		else if (rc != Z_OK)
+		{
+		    break;
+		}
+	    }
+	    while ((zs.avail_in > 0) || (zs.avail_out == 0));
+	    if ((rc != Z_OK) && (rc != Z_STREAM_END))
+	    {
+		fprintf(stderr, "%s: corrupt compressed data\n", qf->filename);
+		break;
+	    }
+	    if ((qf->end >= 0) && (offset >= qf->end))
+	    {
+		break;
+	    }
+	    n = read(fd, buf, sizeof (buf));
+	}
+	inflateEnd(&zs);
+    }
+    else
+#endif
+    {
+	while (n > 0)
+	{
+	    if ((qf->end >= 0) && (offset + n > qf->end))
+	    {
+		n = qf->end - offset;
+	    }
+	    query_block(qf, (char *)buf, n);
+	    offset += n;
+	    if ((qf->end >= 0) && (offset >= qf->end))
+	    {
+		break;
+	    }
+	    n = read(fd, buf, sizeof (buf));
+	}
+    }
+    if (qf->line_len > 0)
+    {
+	query_line(qf, qf->line, qf->line_len);
+	qf->line_len = 0;
+    }
+    free(qf->marks);
+    qf->marks = NULL;
+    close(fd);
+    return NULL;
+}
+
+/* Search the files in a batch in parallel.
+ */
+static void
+query_batch(QUERY_FILE *batch, int n)
+{
+    int		i;
+#if HAVE_PTHREAD_H
+    pthread_t	threads[QUERY_THREADS];
+    int		started[QUERY_THREADS];
+
+    for (i = 0; i < n; i++)
+    {
+	started[i] = (pthread_create(&threads[i], NULL, query_file, &batch[i]) == 0);
+	if (!started[i])
+	{
+	    query_file(&batch[i]);
+	}
+    }
+    for (i = 0; i < n; i++)
+    {
+	if (started[i])
+	{
+	    pthread_join(threads[i], NULL);
+	}
+    }
+#else
+    for (i = 0; i < n; i++)
+    {
+	query_file(&batch[i]);
+    }
+#endif
+}
+
+/* Read the next matching line of a shard into the file it is in,
+ * moving on to the following files of the shard at the end of each.
+ * end is the end of the files of the period.
+ *
+ * Returns the file holding the line, or NULL at the end of the shard.
+ */
+static QUERY_FILE *
+query_next(QUERY_FILE *qf, QUERY_FILE *end)
+{
+    QUERY_LINE	header;
+    int		shard = qf->shard;
+
+    for (; (qf < end) && (qf->shard == shard); qf++)
+    {
+	if (   (fread(&header, sizeof (header), 1, qf->out) == 1)
+	    && (header.len <= sizeof (qf->line))
+	    && (fread(qf->line, 1, header.len, qf->out) == header.len))
+	{
+	    qf->line_time = header.time;
+	    qf->line_len  = header.len;
+	    return qf;
+	}
+	fclose(qf->out);
+	qf->out = NULL;
+    }
+    return NULL;
+}
+
+/* Print the results of the search of the files of a period, merging
+ * the shards on the times of their lines (the lower shard first where
+ * the times are equal).
+ */
+static void
+query_merge(QUERY_FILE *files, int n_files, int n_shards)
+{
+    QUERY_FILE	**current;
+    QUERY_FILE	*next;
+    int		shard;
+    int		i;
+
+    if ((current = calloc((unsigned)n_shards, sizeof (QUERY_FILE *))) == NULL)
+    {
+	perror("calloc");
+	exit(1);
+    }
+    for (i = 0; i < n_files; i++)
+    {
+	rewind(files[i].out);
+	if ((i == 0) || (files[i].shard != files[i - 1].shard))
+	{
+	    current[files[i].shard] = &files[i];
+	}
+    }
+    for (shard = 0; shard < n_shards; shard++)
+    {
+	if (current[shard])
+	{
+	    current[shard] = query_next(current[shard], files + n_files);
+	}
+    }
+    for (;;)
+    {
+	for (next = NULL, shard = 0; shard < n_shards; shard++)
+	{
+	    if (current[shard] && (!next || (current[shard]->line_time < next->line_time)))
+	    {
+		next = current[shard];
+	    }
+	}
+	if (next == NULL)
+	{
+	    break;
+	}
+	fwrite(next->line, 1, next->line_len, stdout);
+	current[next->shard] = query_next(next, files + n_files);
+    }
+    free(current);
+}
+
+/* Print the lines of the log files of an output that were written
+ * between two times.  The files of each period are generated from
+ * the template: all shards, and all sequence numbers until one does
+ * not exist.
+ *
+ * Returns the number of files searched.
+ */
+int
+query_logs(LOG_OUTPUT *output, time_t from, time_t to)
+{
+    QUERY_FILE		*files = NULL;
+    QUERY_FILE		*more;
+    struct stat		stat_buf;
+    struct tm		tm;
+    time_t		period;
+    int			n_alloc = 0;
+    int			n_period;
+    int			n_files = 0;
+    int			sequence;
+    int			shard;
+    int			i;
+    int			has_sequence = template_has_specifier(output->template, "N");
+
+    period = start_of_this_period(from - output->period_delay,
+				  output->periodicity, output->period_multiple);
+    while (period + output->period_delay <= to + QUERY_SLACK)
+    {
+	localtime_r(&period, &tm);
+	n_period = 0;
+	for (shard = 0; shard < output->n_shards; shard++)
+	{
+	    for (sequence = 0; ; sequence++)
+	    {
+		QUERY_FILE	*qf;
+
+		if (n_period == n_alloc)
+		{
+		    n_alloc += QUERY_THREADS;
+		    if ((more = realloc(files, n_alloc * sizeof (QUERY_FILE))) == NULL)
+		    {
+			perror("realloc");
+			exit(1);
+		    }
+		    files = more;
+		}
+		qf = &files[n_period];
+		expand_template(output->template, sequence, shard, &tm,
+				qf->filename, sizeof (qf->filename));
+		if (stat(qf->filename, &stat_buf) < 0)
+		{
+		    DEBUG(("\"%s\" does not exist\n", qf->filename));
+		    break;
+		}
+		qf->shard    = shard;
+		qf->from     = from;
+		qf->to       = to;
+		qf->line_len = 0;
+		if ((qf->out = tmpfile()) == NULL)
+		{
+		    perror("tmpfile");
+		    exit(1);
+		}
+		n_period++;
+		if (!has_sequence)
+		{
+		    break;
+		}
+	    }
+	}
+	for (i = 0; i < n_period; i += QUERY_THREADS)
+	{
+	    query_batch(files + i, (n_period - i < QUERY_THREADS) ? n_period - i : QUERY_THREADS);
+	}
+	query_merge(files, n_period, output->n_shards);
+	n_files += n_period;
+	if (output->periodicity == ONCE_ONLY)
+	{
+	    break;
+	}
+	period = start_of_next_period(period, output->periodicity, output->period_multiple);
+    }
+    free(files);
+    fflush(stdout);
+    return n_files;
+}
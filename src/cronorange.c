@@ -0,0 +1,489 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronorange -- parallel splitting of large input files for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * When a large uncompressed log file is split with several jobs
+ * ("cronolog -j jobs -i file ...") the file is mapped into memory and
+ * divided into chunks of RANGE_CHUNK_SIZE bytes, each moved on to the
+ * start of a line.  A pool of threads parses the timestamps of the
+ * lines of the chunks, each thread taking the next chunk, and cuts
+ * each chunk into segments: runs of lines that go to the same log
+ * file of every output.  The main thread takes the segments in the
+ * order of the file, so the log files come out as if the file had
+ * been split line by line, and copies each segment from the input
+ * file to the log files while the threads parse the chunks that
+ * follow.  No more than RANGE_AHEAD
+ * chunks are parsed ahead of the main thread.
+ *
+ * The segments are copied with copy_file_range() where the system has
+ * it, so that the data is copied within the kernel (or on some file
+ * systems not at all), and otherwise written from the mapping.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1		/* for copy_file_range() */
+#endif
+
+#include "cronoutils.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+
+/* The segments of a chunk, once parsed */
+
+typedef struct
+{
+    RANGE_SEGMENT	*segments;
+    int			n_segments;
+    int			size;
+    int			done;
+}
+RANGE_CHUNK;
+
+
+static LOG_OUTPUT	*range_outputs;
+static int		range_n_outputs;
+static int		range_fd = -1;
+static char		*range_map = NULL;
+static off_t		range_size = 0;
+static off_t		range_skip = 0;		/* offset at which to start */
+static RANGE_CHUNK	*chunks = NULL;
+static long		n_chunks = 0;
+static long		next_chunk = 0;		/* next chunk to be parsed */
+static long		current = 0;		/* chunk being copied */
+static int		segment = 0;		/* next segment of that chunk */
+
+#if HAVE_PTHREAD_H
+static pthread_mutex_t	range_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	range_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t	*range_threads = NULL;
+static int		n_threads = 0;
+#define LOCK()		pthread_mutex_lock(&range_lock)
+#define UNLOCK()	pthread_mutex_unlock(&range_lock)
+#define WAIT()		pthread_cond_wait(&range_cond, &range_lock)
+#define SIGNAL()	pthread_cond_broadcast(&range_cond)
+#else
+#define LOCK()
+#define UNLOCK()
+#define WAIT()
+#define SIGNAL()
+#endif
+
+
+/* Return the offset of the first line that starts in a chunk (the
+ * end of the file if there is none).
+ */
+static off_t
+chunk_start(long chunk)
+{
+    off_t	start = range_skip + (off_t)chunk * RANGE_CHUNK_SIZE;
+    char	*eol;
+
+    if (chunk == 0)
+    {
+	return range_skip;
+    }
+    if (start >= range_size)
+    {
+	return range_size;
+    }
+    eol = memchr(range_map + start - 1, '\n', range_size - start + 1);
+    return eol ? (eol + 1 - range_map) : range_size;
+}
+
+/* Add a segment to a chunk.
+ */
+static void
+add_segment(RANGE_CHUNK *chunk, const RANGE_SEGMENT *seg)
+{
+    if (chunk->n_segments == chunk->size)
+    {
+	chunk->size     = chunk->size ? 2 * chunk->size : 16;
+	chunk->segments = realloc(chunk->segments, chunk->size * sizeof (RANGE_SEGMENT));
+	if (chunk->segments == NULL)
+	{
+	    perror("input");
+	    exit(1);
+	}
+    }
+    chunk->segments[chunk->n_segments++] = *seg;
+}
+
+/* Cut a chunk into segments.  A segment ends where a line's time is
+ * outside the period of the segment for any of the outputs; the
+ * intersection of those periods is kept in [lo, hi).  Lines at the
+ * start of the chunk without a timestamp make up a segment with no
+ * time, as their time is that of the end of the chunk before.
+ */
+static void
+scan_chunk(long number, RANGE_CHUNK *chunk)
+{
+    RANGE_SEGMENT	seg;
+    LOG_OUTPUT		*output;
+    const char		*line;
+    const char		*eol;
+    const char		*end;
+    time_t		line_time;
+    time_t		lo = 0;
+    time_t		hi = 0;
+    time_t		start;
+    time_t		next;
+
+    line = range_map + chunk_start(number);
+    end  = range_map + chunk_start(number + 1);
+
+    seg.data    = line;
+    seg.len     = 0;
+    seg.time    = -1;
+    seg.undated = 0;
+    for (; line < end; line = eol)
+    {
+	eol = memchr(line, '\n', end - line);
+	eol = eol ? eol + 1 : end;
+	if (parse_clf_time(line, eol - line, &line_time) < 0)
+	{
+	    if (seg.time == -1)
+	    {
+		seg.undated++;
+	    }
+	}
+	else if ((seg.time == -1) || (line_time < lo) || (line_time >= hi))
+	{
+	    if (line > seg.data)
+	    {
+		seg.len    = line - seg.data;
+		seg.offset = seg.data - range_map;
+		add_segment(chunk, &seg);
+	    }
+	    seg.data    = line;
+	    seg.time    = line_time;
+	    seg.undated = 0;
+	    lo = 0;
+	    hi = FAR_DISTANT_FUTURE;
+	    for (output = range_outputs; output < range_outputs + range_n_outputs; output++)
+	    {
+		start = start_of_this_period(line_time, output->periodicity,
+					     output->period_multiple);
+		next  = start_of_next_period(start, output->periodicity,
+					     output->period_multiple);
+		lo = (start > lo) ? start : lo;
+		hi = (next  < hi) ? next  : hi;
+	    }
+	}
+    }
+    if (line > seg.data)
+    {
+	seg.len    = line - seg.data;
+	seg.offset = seg.data - range_map;
+	add_segment(chunk, &seg);
+    }
+}
+
+#if HAVE_PTHREAD_H
+/* Parsing thread: parse the next chunk, unless it is too far ahead of
+ * the chunk being copied, until there are none left.
+ */
+static void *
+range_thread(void *arg)
+{
+    long	number;
+
+    (void)arg;
+    LOCK();
+    for (;;)
+    {
+	if (next_chunk >= n_chunks)
+	{
+	    break;
+	}
+	if (next_chunk >= current + RANGE_AHEAD)
+	{
+	    WAIT();
+	    continue;
+	}
+	number = next_chunk++;
+	UNLOCK();
+	scan_chunk(number, &chunks[number]);
+	LOCK();
+	chunks[number].done = 1;
+	SIGNAL();
+    }
+    UNLOCK();
+    return NULL;
+}
+#endif
+
+/* Map an uncompressed input file and start parsing it from offset
+ * skip with n_threads threads.
+ *
+ * Returns the file descriptor of the file, or -1 on error (with errno
+ * set; EINVAL if the file is compressed).
+ */
+int
+range_open(const char *path, off_t skip, LOG_OUTPUT *outputs, int n_outputs,
+	   int n_threads_wanted)
+{
+#if HAVE_SYS_MMAN_H
+    struct stat	st;
+
+    if ((range_fd = open(path, O_RDONLY)) < 0)
+    {
+	return -1;
+    }
+    if (fstat(range_fd, &st) < 0)
+    {
+	close(range_fd);
+	return range_fd = -1;
+    }
+    range_size = st.st_size;
+    range_map  = NULL;
+    if (   (range_size > 0)
+	&& ((range_map = mmap(NULL, range_size, PROT_READ, MAP_SHARED, range_fd, 0)) == MAP_FAILED))
+    {
+	close(range_fd);
+	return range_fd = -1;
+    }
+    if (input_type(range_map, range_size) != INPUT_PLAIN)
+    {
+	range_close();
+	errno = EINVAL;
+	return -1;
+    }
+    range_outputs   = outputs;
+    range_n_outputs = n_outputs;
+    range_skip = (skip < range_size) ? skip : range_size;
+    n_chunks   = (range_size - range_skip + RANGE_CHUNK_SIZE - 1) / RANGE_CHUNK_SIZE;
+    next_chunk = 0;
+    current    = 0;
+    segment    = 0;
+    if ((chunks = calloc(n_chunks + 1, sizeof (RANGE_CHUNK))) == NULL)
+    {
+	range_close();
+	return -1;
+    }
+#if HAVE_PTHREAD_H
+    if ((range_threads = calloc(n_threads_wanted, sizeof (pthread_t))) == NULL)
+    {
+	range_close();
+	return -1;
+    }
+    for (n_threads = 0; n_threads < n_threads_wanted; n_threads++)
+    {
+	if (pthread_create(&range_threads[n_threads], NULL, range_thread, NULL) != 0)
+	{
+	    break;
+	}
+    }
+    DEBUG(("Splitting %ld chunk(s) of \"%s\" with %d thread(s)\n", n_chunks, path, n_threads));
+#else
+    (void)n_threads_wanted;
+#endif
+    return range_fd;
+#else
+    (void)path;
+    (void)skip;
+    (void)outputs;
+    (void)n_outputs;
+    (void)n_threads_wanted;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Return the next segment of the input file, in order.
+ *
+ * Returns 1, or 0 at the end of the file.
+ */
+int
+range_next(RANGE_SEGMENT *seg)
+{
+    RANGE_CHUNK	*chunk;
+
+    LOCK();
+    while (current < n_chunks)
+    {
+	chunk = &chunks[current];
+#if !HAVE_PTHREAD_H
+	if (!chunk->done)
+	{
+	    scan_chunk(current, chunk);
+	    chunk->done = 1;
+	}
+#endif
+	while (!chunk->done)
+	{
+	    WAIT();
+	}
+	if (segment < chunk->n_segments)
+	{
+	    *seg = chunk->segments[segment++];
+	    UNLOCK();
+	    return 1;
+	}
+	free(chunk->segments);
+	chunk->segments = NULL;
+	current++;
+	segment = 0;
+	SIGNAL();
+    }
+    UNLOCK();
+    return 0;
+}
+
+/* Copy a segment of the input file to the end of a log file.
+ *
+ * Returns the number of bytes copied, or -1 on error (with errno set).
+ */
+ssize_t
+range_copy(int fd, const RANGE_SEGMENT *seg)
+{
+    size_t	done = 0;
+    ssize_t	n;
+#if HAVE_COPY_FILE_RANGE
+    static int	no_copy = 0;
+    loff_t	offset = seg->offset;
+
+    while (!no_copy && (done < seg->len))
+    {
+	n = copy_file_range(range_fd, &offset, fd, NULL, seg->len - done, 0);
+	if (n > 0)
+	{
+	    done += n;
+	}
+	else if ((n == 0) || (errno == ENOSYS) || (errno == EXDEV) || (errno == EINVAL)
+		 || (errno == EOPNOTSUPP) || (errno == EBADF))
+	{
+	    DEBUG(("copy_file_range() not usable, writing instead\n"));
+	    no_copy = 1;
+	}
+	else if (errno != EINTR)
+	{
+	    return -1;
+	}
+    }
+#endif
+    while (done < seg->len)
+    {
+	if ((n = write(fd, seg->data + done, seg->len - done)) > 0)
+	{
+	    done += n;
+	}
+	else if (errno != EINTR)
+	{
+	    return -1;
+	}
+    }
+    return done;
+}
+
+/* Finish with the input file.
+ */
+void
+range_close(void)
+{
+    long	i;
+
+#if HAVE_PTHREAD_H
+    LOCK();
+    n_chunks = next_chunk;
+    SIGNAL();
+    UNLOCK();
+    for (i = 0; i < n_threads; i++)
+    {
+	pthread_join(range_threads[i], NULL);
+    }
+    free(range_threads);
+    range_threads = NULL;
+    n_threads     = 0;
+#endif
+    if (chunks)
+    {
+	for (i = 0; i < n_chunks; i++)
+	{
+	    free(chunks[i].segments);
+	}
+	free(chunks);
+	chunks = NULL;
+    }
+#if HAVE_SYS_MMAN_H
+    if (range_map)
+    {
+	munmap(range_map, range_size);
+	range_map = NULL;
+    }
+#endif
+    if (range_fd >= 0)
+    {
+	close(range_fd);
+	range_fd = -1;
+    }
+    n_chunks = 0;
+}
@@ -0,0 +1,381 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoretain -- retention of old log files for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * A template may be given a retention policy: keep the files of the
+ * last N periods, keep the files of periods that ended less than a
+ * given time ago, or keep the total size of the template's files
+ * under a limit (or any combination of these).  Whenever cronolog
+ * opens a new log file for the template, the names of the files of
+ * earlier periods are generated from the template by walking
+ * backwards with start_of_this_period() -- in the same way as
+ * "cronolog --query" walks forwards -- rather than by searching the
+ * log directories.  Files of expired periods are deleted together
+ * with their index and checksum sidecars, and any directories left
+ * empty are removed, down to the first directory of the template
+ * whose name does not depend on the time.
+ *
+ * The walk stops after RETAIN_GAP consecutive periods without files,
+ * so once the old files have been deleted each pass only looks at
+ * the periods that are kept and a few more.  A gap of more than
+ * RETAIN_GAP periods in the logs hides any older files from the
+ * retention worker.
+ *
+ * The files are deleted by a worker thread so that writing the log is
+ * not held up.  Each new file queues a pass for its template, with a
+ * copy of its output; if a pass for the template is still waiting it
+ * is brought up to date instead.  (Without threads the files are
+ * deleted as the new file is opened.)
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+
+/* Return the length of the part of the template's directory that does
+ * not depend on the time (up to the last "/" before the first "%").
+ * Directories below that are removed when they become empty.
+ */
+static size_t
+retain_fixed_length(const char *template)
+{
+    const char	*spec  = strchr(template, '%');
+    const char	*p;
+    size_t	len = 0;
+
+    for (p = template; *p && (spec == NULL || p < spec); p++)
+    {
+	if (*p == '/')
+	{
+	    len = p - template;
+	}
+    }
+    return len;
+}
+
+/* Delete a log file and its sidecar files, then remove the
+ * directories on its path that are left empty.
+ */
+static void
+retain_unlink(const char *filename, size_t fixed_len)
+{
+    char	path[MAX_PATH];
+    char	*slash;
+
+    DEBUG(("Removing expired log file \"%s\"\n", filename));
+    if ((unlink(filename) < 0) && (errno != ENOENT))
+    {
+	perror(filename);
+	return;
+    }
+    if (index_filename(filename, path, sizeof (path)) == 0)
+    {
+	unlink(path);
+    }
+    if (checksum_filename(filename, path, sizeof (path)) == 0)
+    {
+	unlink(path);
+    }
+
+    snprintf(path, sizeof (path), "%s", filename);
+    while (   ((slash = strrchr(path, '/')) != NULL)
+	   && ((size_t)(slash - path) > fixed_len))
+    {
+	*slash = '\0';
+	if (rmdir(path) < 0)
+	{
+	    break;
+	}
+	DEBUG(("Removed empty directory \"%s\"\n", path));
+    }
+}
+
+/* Find the log files of the period starting at a given time (all
+ * shards, and all sequence numbers until one does not exist) and
+ * delete them if remove is set.
+ *
+ * Returns the total size of the files, or -1 if there are none.
+ */
+static off_t
+retain_period(LOG_OUTPUT *output, time_t period, size_t fixed_len, int remove)
+{
+    char	filename[MAX_PATH];
+    struct stat	stat_buf;
+    struct tm	tm;
+    off_t	size = -1;
+    int		has_sequence = template_has_specifier(output->template, "N");
+    int		sequence;
+    int		shard;
+
+    localtime_r(&period, &tm);
+    for (shard = 0; shard < output->n_shards; shard++)
+    {
+	for (sequence = 0; ; sequence++)
+	{
+	    expand_template(output->template, sequence, shard, &tm,
+			    filename, sizeof (filename));
+	    if (stat(filename, &stat_buf) < 0)
+	    {
+		break;
+	    }
+	    size = ((size < 0) ? 0 : size) + stat_buf.st_size;
+	    if (remove)
+	    {
+		retain_unlink(filename, fixed_len);
+	    }
+	    if (!has_sequence)
+	    {
+		break;
+	    }
+	}
+    }
+    return size;
+}
+
+/* Walk back through the periods before the current one, deleting the
+ * files of the periods that the retention policy does not keep.  Once
+ * a period has expired so have all earlier ones.
+ */
+static void
+retain_prune(LOG_OUTPUT *output, time_t time_now)
+{
+    size_t	fixed_len = retain_fixed_length(output->template);
+    time_t	period    = output->period_start;
+    time_t	end;
+    off_t	total;
+    off_t	size;
+    int		n_periods = 0;
+    int		gap       = 0;
+    int		expired   = 0;
+
+    total = retain_period(output, period, fixed_len, 0);
+    if (total < 0)
+    {
+	total = 0;
+    }
+    while (gap < RETAIN_GAP)
+    {
+	end    = period;
+	period = start_of_this_period(period - 1, output->periodicity,
+				      output->period_multiple);
+	n_periods++;
+	if ((size = retain_period(output, period, fixed_len, 0)) < 0)
+	{
+	    gap++;
+	    continue;
+	}
+	gap    = 0;
+	total += size;
+	if (!expired)
+	{
+	    expired = (   (output->retain_periods && (n_periods >= output->retain_periods))
+		       || (output->retain_age
+			   && (end + output->period_delay <= time_now - output->retain_age))
+		       || (output->retain_bytes && (total > output->retain_bytes)));
+	}
+	if (expired)
+	{
+	    retain_period(output, period, fixed_len, 1);
+	}
+    }
+}
+
+#if HAVE_PTHREAD_H
+/* A pass of the retention worker: a copy of the output, with its
+ * template (as the output of a pipe handed over by cronolog-attach is
+ * freed when the pipe is finished), and the time its file was opened.
+ */
+typedef struct retain_job
+{
+    LOG_OUTPUT		output;
+    char		template[MAX_PATH];
+    time_t		time_now;
+    struct retain_job	*next;
+}
+RETAIN_JOB;
+
+static pthread_mutex_t	retain_lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	retain_cond    = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	retain_idle    = PTHREAD_COND_INITIALIZER;
+static RETAIN_JOB	*retain_queue  = NULL;
+static int		retain_running = 0;
+static int		retain_started = 0;
+
+/* The retention worker: make each pass queued, in turn.
+ */
+static void *
+retain_thread(void *arg)
+{
+    RETAIN_JOB	*job;
+
+    (void)arg;
+    pthread_mutex_lock(&retain_lock);
+    for (;;)
+    {
+	while (retain_queue == NULL)
+	{
+	    pthread_cond_wait(&retain_cond, &retain_lock);
+	}
+	job            = retain_queue;
+	retain_queue   = job->next;
+	retain_running = 1;
+	pthread_mutex_unlock(&retain_lock);
+
+	retain_prune(&job->output, job->time_now);
+	free(job);
+
+	pthread_mutex_lock(&retain_lock);
+	retain_running = 0;
+	pthread_cond_broadcast(&retain_idle);
+    }
+    return NULL;
+}
+
+/* Let the worker finish the passes queued when cronolog exits (but not
+ * when it is killed by a signal).
+ */
+static void
+retain_wait(void)
+{
+    pthread_mutex_lock(&retain_lock);
+    while (retain_queue || retain_running)
+    {
+	pthread_cond_wait(&retain_idle, &retain_lock);
+    }
+    pthread_mutex_unlock(&retain_lock);
+}
+#endif
+
+/* Apply the retention policy of an output when it opens a new log
+ * file.  The files of all shards of a template are handled by the
+ * output for its first shard.
+ */
+void
+retain_logs(LOG_OUTPUT *output, time_t time_now)
+{
+#if HAVE_PTHREAD_H
+    RETAIN_JOB	**pjob;
+    RETAIN_JOB	*job;
+    pthread_t	thread;
+#endif
+
+    if (   (output->shard != 0)
+	|| !(output->retain_periods || output->retain_age || output->retain_bytes))
+    {
+	return;
+    }
+#if HAVE_PTHREAD_H
+    pthread_mutex_lock(&retain_lock);
+    for (pjob = &retain_queue; *pjob; pjob = &(*pjob)->next)
+    {
+	if (strcmp((*pjob)->template, output->template) == 0)
+	{
+	    break;
+	}
+    }
+    if ((job = *pjob) != NULL)
+    {
+	DEBUG(("Retention pass for \"%s\" is still waiting\n", output->template));
+    }
+    else if ((job = malloc(sizeof (RETAIN_JOB))) != NULL)
+    {
+	job->next = NULL;
+	*pjob     = job;
+    }
+    if (job)
+    {
+	job->output = *output;
+	snprintf(job->template, sizeof (job->template), "%s", output->template);
+	job->output.template = job->template;
+	job->time_now        = time_now;
+    }
+    if (!retain_started && (pthread_create(&thread, NULL, retain_thread, NULL) == 0))
+    {
+	pthread_detach(thread);
+	atexit(retain_wait);
+	retain_started = 1;
+    }
+    if (retain_started)
+    {
+	pthread_cond_signal(&retain_cond);
+	pthread_mutex_unlock(&retain_lock);
+	return;
+    }
+
+    /* Without a worker, make the pass now */
+
+    if (job)
+    {
+	*pjob = NULL;
+	free(job);
+    }
+    pthread_mutex_unlock(&retain_lock);
+#endif
+    retain_prune(output, time_now);
+}
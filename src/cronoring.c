@@ -0,0 +1,547 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoring -- shared memory ring transport for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * With the option "-b name" cronolog creates (or reuses) a POSIX
+ * shared memory segment "name" holding a ring of log records, which
+ * producer processes linked with libcronolog fill with
+ * cronolog_ring_write() (see cronolog.h) and cronolog drains into its
+ * log files alongside its standard input, so that logging a line
+ * costs the producer a copy into shared memory rather than a write to
+ * a pipe.
+ *
+ * The segment is a header followed by RING_SIZE bytes of records,
+ * each a RING_RECORD header followed by the data, rounded up to 16
+ * bytes.  head and tail count the bytes ever reserved by producers
+ * and consumed by cronolog:
+ *
+ *  - a producer reserves space by advancing head with a
+ *    compare-and-swap (first reserving a padding record to the end of
+ *    the ring if the record would not fit before it), copies in its
+ *    data and then publishes the record by storing its position in
+ *    its header;
+ *
+ *  - cronolog takes records in order from tail while the header
+ *    there holds the position of the tail (so that an old or a
+ *    partly written record is never taken), then advances tail.
+ *
+ * A producer that finds the ring full gets EAGAIN rather than
+ * waiting.  When cronolog finds the ring empty it sets "waiting" and
+ * sleeps on the futex word "wakeup"; a producer that publishes a
+ * record while it is set bumps the word and wakes it.  Where futexes
+ * are not available cronolog polls the ring.  (A producer that dies
+ * between reserving and publishing a record stops the ring.)
+ */
+
+#include "cronoutils.h"
+#include "cronolog.h"
+
+#if HAVE_SHM_OPEN && HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+
+#define RING_MAGIC	"CRONORG"
+#define RING_PADDING	0x80000000U	/* flag in len: skip to the end of the ring */
+#define RING_ALIGN(n)	(((n) + 15) & ~(size_t)15)	/* records start on 16 bytes */
+
+typedef struct
+{
+    char		magic[8];
+    unsigned long	size;		/* bytes of records (a power of 2) */
+    unsigned long	max_len;	/* largest record that cronolog takes */
+    volatile unsigned long long head;	/* bytes reserved by producers */
+    char		pad1[64];	/* keep head and tail in separate cache lines */
+    volatile unsigned long long tail;	/* bytes consumed by cronolog */
+    volatile int	waiting;	/* cronolog is asleep */
+    volatile int	wakeup;		/* futex word, bumped to wake cronolog */
+    char		pad2[48];
+}
+RING_HEADER;
+
+typedef struct
+{
+    volatile unsigned long long pos;	/* position of the record once published */
+    unsigned int	len;		/* length of the data (or of the padding) */
+    unsigned int	unused;
+}
+RING_RECORD;
+
+struct cronolog_ring
+{
+    RING_HEADER		*header;
+    char		*data;
+    size_t		map_size;
+};
+
+
+#if HAVE_SHM_OPEN && HAVE_SYS_MMAN_H
+
+/* Map a ring segment, creating it with size bytes of records if
+ * create is set and it does not exist.
+ *
+ * Returns 0 on success or -1 on error (with errno set).
+ */
+static int
+ring_map(CRONOLOG_RING *ring, const char *name, int create, size_t size)
+{
+    char		path[MAX_PATH];
+    struct stat		stat_buf;
+    RING_HEADER		*header;
+    int			fd;
+    int			err;
+
+    snprintf(path, sizeof (path), "%s%s", (*name == '/') ? "" : "/", name);
+    fd = shm_open(path, O_RDWR, FILE_MODE);
+    if ((fd < 0) && (errno == ENOENT) && create)
+    {
+	fd = shm_open(path, O_RDWR|O_CREAT, FILE_MODE);
+	if ((fd >= 0) && (ftruncate(fd, sizeof (RING_HEADER) + size) < 0))
+	{
+	    err = errno;
+	    close(fd);
+	    errno = err;
+	    return -1;
+	}
+    }
+    if (fd < 0)
+    {
+	return -1;
+    }
+    if ((fstat(fd, &stat_buf) < 0) || (stat_buf.st_size < (off_t)sizeof (RING_HEADER)))
+    {
+	close(fd);
+	errno = EINVAL;
+	return -1;
+    }
+    header = mmap(NULL, stat_buf.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (header == MAP_FAILED)
+    {
+	errno = err;
+	return -1;
+    }
+
+    /* A new segment is set up by cronolog; producers only use a
+     * segment that has been set up.
+     */
+    if (memcmp(header->magic, RING_MAGIC, sizeof (header->magic)) != 0)
+    {
+	if (!create)
+	{
+	    munmap(header, stat_buf.st_size);
+	    errno = EAGAIN;
+	    return -1;
+	}
+	header->size    = stat_buf.st_size - sizeof (RING_HEADER);
+	header->max_len = (BUFSIZE - 1 < header->size / 4) ? BUFSIZE - 1 : header->size / 4;
+	header->head = header->tail = 0;
+	__sync_synchronize();
+	memcpy(header->magic, RING_MAGIC, sizeof (header->magic));
+    }
+    if (   (header->size & (header->size - 1))
+	|| (sizeof (RING_HEADER) + header->size > (size_t)stat_buf.st_size))
+    {
+	munmap(header, stat_buf.st_size);
+	errno = EINVAL;
+	return -1;
+    }
+    ring->header   = header;
+    ring->data     = (char *)(header + 1);
+    ring->map_size = stat_buf.st_size;
+    return 0;
+}
+
+static void
+ring_unmap(CRONOLOG_RING *ring)
+{
+    munmap(ring->header, ring->map_size);
+    ring->header = NULL;
+}
+
+#else /* !HAVE_SHM_OPEN */
+
+static int
+ring_map(CRONOLOG_RING *ring, const char *name, int create, size_t size)
+{
+    (void)ring;
+    (void)name;
+    (void)create;
+    (void)size;
+    errno = ENOSYS;
+    return -1;
+}
+
+static void
+ring_unmap(CRONOLOG_RING *ring)
+{
+    (void)ring;
+}
+
+#endif
+
+
+/* Producer side (part of libcronolog) */
+
+/* Attach to the ring "name" set up by a cronolog process.
+ *
+ * Returns a handle, or NULL on error (with errno set: ENOENT if there
+ * is no such ring, EAGAIN if cronolog has not yet set it up).
+ */
+CRONOLOG_RING *
+cronolog_ring_attach(const char *name)
+{
+    CRONOLOG_RING	*ring;
+
+    if ((ring = calloc(1, sizeof (*ring))) == NULL)
+    {
+	return NULL;
+    }
+    if (ring_map(ring, name, 0, 0) < 0)
+    {
+	free(ring);
+	return NULL;
+    }
+    return ring;
+}
+
+/* Append a record to a ring and wake cronolog if it is asleep.
+ *
+ * Returns 0 on success or -1 on error (with errno set: EAGAIN if the
+ * ring is full, EMSGSIZE if the record is too large for cronolog).
+ */
+int
+cronolog_ring_write(CRONOLOG_RING *ring, const char *buf, size_t len)
+{
+    RING_HEADER		*header = ring->header;
+    RING_RECORD		*record;
+    unsigned long long	head;
+    size_t		mask = header->size - 1;
+    size_t		need = sizeof (RING_RECORD) + RING_ALIGN(len);
+    size_t		offset;
+    size_t		pad;
+
+    if (len > header->max_len)
+    {
+	errno = EMSGSIZE;
+	return -1;
+    }
+    do
+    {
+	head   = header->head;
+	offset = head & mask;
+	pad    = (offset + need > header->size) ? header->size - offset : 0;
+	if (head + pad + need - header->tail > header->size)
+	{
+	    errno = EAGAIN;
+	    return -1;
+	}
+    }
+    while (!__sync_bool_compare_and_swap(&header->head, head, head + pad + need));
+
+    if (pad)
+    {
+	record = (RING_RECORD *)(ring->data + offset);
+	record->len = pad | RING_PADDING;
+	__sync_synchronize();
+	record->pos = head;
+	head  += pad;
+	offset = 0;
+    }
+    record = (RING_RECORD *)(ring->data + offset);
+    record->len = len;
+    memcpy(record + 1, buf, len);
+    __sync_synchronize();
+    record->pos = head;
+
+    __sync_synchronize();
+    if (header->waiting)
+    {
+	__sync_fetch_and_add(&header->wakeup, 1);
+#if HAVE_LINUX_FUTEX_H
+	syscall(SYS_futex, &header->wakeup, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+    }
+    return 0;
+}
+
+/* Detach from a ring.
+ */
+void
+cronolog_ring_detach(CRONOLOG_RING *ring)
+{
+    if (ring == NULL)
+    {
+	return;
+    }
+    ring_unmap(ring);
+    free(ring);
+}
+
+
+/* Consumer side (cronolog) */
+
+static CRONOLOG_RING	consumer;
+
+#if HAVE_PTHREAD_H
+static pthread_t	ring_waiter;
+static pthread_mutex_t	ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	ring_cond = PTHREAD_COND_INITIALIZER;
+static int		ring_pending = 0;	/* notified, not yet drained */
+static int		ring_pipe[2] = { -1, -1 };
+#endif
+
+/* Create or reuse the ring "name" for cronolog to drain.
+ *
+ * Returns 0 on success or -1 on error (with errno set).
+ */
+int
+ring_open(const char *name)
+{
+    if (ring_map(&consumer, name, 1, RING_SIZE) < 0)
+    {
+	return -1;
+    }
+    DEBUG(("Draining ring \"%s\" of %lu bytes\n", name, consumer.header->size));
+    return 0;
+}
+
+/* Copy whole records from the ring into buf (of at least BUFSIZE
+ * bytes, so that the largest record fits), adding a newline to any
+ * that does not end with one, and free their space.
+ *
+ * Returns the number of bytes copied (0 if there are no records).
+ */
+ssize_t
+ring_read(char *buf, size_t buflen)
+{
+    RING_HEADER		*header = consumer.header;
+    RING_RECORD		*record;
+    unsigned long long	tail = header->tail;
+    size_t		mask = header->size - 1;
+    size_t		used = 0;
+    size_t		len;
+
+    while (tail != header->head)
+    {
+	record = (RING_RECORD *)(consumer.data + (tail & mask));
+	if (record->pos != tail)
+	{
+	    break;
+	}
+	__sync_synchronize();
+	if (record->len & RING_PADDING)
+	{
+	    tail += record->len & ~RING_PADDING;
+	    continue;
+	}
+	len = record->len;
+	if (used + len + 1 > buflen)
+	{
+	    break;
+	}
+	memcpy(buf + used, record + 1, len);
+	used += len;
+	if ((len == 0) || (buf[used - 1] != '\n'))
+	{
+	    buf[used++] = '\n';
+	}
+	tail += sizeof (RING_RECORD) + RING_ALIGN(record->len);
+    }
+    __sync_synchronize();
+    header->tail = tail;
+    return used;
+}
+
+#if HAVE_PTHREAD_H
+/* Check whether the record at the tail of the ring is published.
+ */
+static int
+ring_ready(void)
+{
+    RING_HEADER		*header = consumer.header;
+    RING_RECORD		*record;
+
+    record = (RING_RECORD *)(consumer.data + (header->tail & (header->size - 1)));
+    return (header->tail != header->head) && (record->pos == header->tail);
+}
+
+/* Sleep until the ring has a record.
+ */
+static void
+ring_wait(void)
+{
+    RING_HEADER		*header = consumer.header;
+#if HAVE_LINUX_FUTEX_H
+    int			wakeup;
+#endif
+
+    while (!ring_ready())
+    {
+#if HAVE_LINUX_FUTEX_H
+	wakeup = header->wakeup;
+#endif
+	header->waiting = 1;
+	__sync_synchronize();
+	if (!ring_ready())
+	{
+#if HAVE_LINUX_FUTEX_H
+	    struct timespec	timeout;
+
+	    timeout.tv_sec  = 1;
+	    timeout.tv_nsec = 0;
+	    syscall(SYS_futex, &header->wakeup, FUTEX_WAIT, wakeup, &timeout, NULL, 0);
+#else
+	    usleep(RING_POLL_MS * 1000);
+#endif
+	}
+	header->waiting = 0;
+    }
+}
+
+/* Wait for records in the ring and make the notification descriptor
+ * readable, then wait until they have been drained.
+ */
+static void *
+ring_thread(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+	ring_wait();
+	pthread_mutex_lock(&ring_lock);
+	ring_pending = 1;
+	if (write(ring_pipe[1], "", 1) < 0)
+	{
+	    DEBUG(("Cannot notify the main thread of ring records\n"));
+	}
+	while (ring_pending)
+	{
+	    pthread_cond_wait(&ring_cond, &ring_lock);
+	}
+	pthread_mutex_unlock(&ring_lock);
+    }
+    return NULL;
+}
+#endif
+
+/* Start a thread that waits for records in the ring.
+ *
+ * Returns a descriptor that becomes readable when there are records
+ * to drain, or -1 if there is no such thread (the caller must then
+ * poll the ring every RING_POLL_MS milliseconds).
+ */
+int
+ring_notify_fd(void)
+{
+#if HAVE_PTHREAD_H
+    if (pipe(ring_pipe) < 0)
+    {
+	return -1;
+    }
+    if (pthread_create(&ring_waiter, NULL, ring_thread, NULL) != 0)
+    {
+	close(ring_pipe[0]);
+	close(ring_pipe[1]);
+	ring_pipe[0] = ring_pipe[1] = -1;
+	return -1;
+    }
+    return ring_pipe[0];
+#else
+    return -1;
+#endif
+}
+
+/* Tell the waiting thread that the records it was notified of have
+ * been drained.
+ */
+void
+ring_drained(void)
+{
+#if HAVE_PTHREAD_H
+    char	c;
+
+    if (ring_pipe[0] < 0)
+    {
+	return;
+    }
+    pthread_mutex_lock(&ring_lock);
+    if (ring_pending && (read(ring_pipe[0], &c, 1) == 1))
+    {
+	ring_pending = 0;
+	pthread_cond_signal(&ring_cond);
+    }
+    pthread_mutex_unlock(&ring_lock);
+#endif
+}
@@ -0,0 +1,429 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronoshared -- coordination of cronolog processes on one host
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * A busy server may run many cronolog processes with the same
+ * template (several servers logging to the same files, which is safe
+ * as log files are opened for appending).  At the start of each
+ * period they all compute the same period boundaries, race to create
+ * the same directories and replace the same links, each renaming the
+ * link that another has just made.
+ *
+ * If coordination is requested, the processes writing a template
+ * share a small POSIX shared memory segment, named after a hash of
+ * the template, holding:
+ *
+ *  - the boundaries of the current period, published under the lock
+ *    by the first process to compute them and read by the others
+ *    without locking (a sequence count, odd during an update, shows
+ *    whether they were read consistently; a publisher that finds it
+ *    odd while holding the lock knows the last one died mid-update);
+ *
+ *  - the directory of the current log file, once a process has
+ *    created it: a process whose open fails because the directory is
+ *    missing takes the segment's lock and only walks the path
+ *    creating directories if no other process has done so while it
+ *    waited;
+ *
+ *  - the file that each link points to (for up to SHARED_LINKS link
+ *    names): a link is only replaced by the first process with that
+ *    link name to open a new file, under the lock.
+ *
+ * The lock is an fcntl() lock on the segment, so it is released if a
+ * process dies.  The segments are left in place for later processes.
+ * A segment is only used if it belongs to the user running cronolog
+ * and no one else can write to it, so that another local user cannot
+ * create it first and steer the rotation of the files; otherwise
+ * cronolog runs without coordination.
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_SHM_OPEN && HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+
+
+#define SHARED_MAGIC	"CRONOS2"
+#define SHARED_MODE	(S_IRUSR | S_IWUSR)
+
+typedef struct
+{
+    char		name[MAX_PATH];		/* name of the link */
+    char		target[MAX_PATH];	/* file that it points to */
+}
+SHARED_LINK;
+
+typedef struct
+{
+    char		magic[8];
+    char		template[MAX_PATH];
+    volatile unsigned	seq;		/* odd while the period is being updated */
+    PERIODICITY		periodicity;
+    int			period_multiple;
+    time_t		period_start;	/* current period */
+    time_t		next_period;	/* start of the next period (without delay) */
+    char		dir[MAX_PATH];	/* directory created for the current period */
+    SHARED_LINK		links[SHARED_LINKS];	/* links made by the processes */
+}
+SHARED_STATE;
+
+
+/* Take or release the lock on the segment of an output.
+ */
+static void
+shared_lock(LOG_OUTPUT *output, int type)
+{
+    struct flock	fl;
+
+    memset(&fl, 0, sizeof (fl));
+    fl.l_type   = type;
+    fl.l_whence = SEEK_SET;
+    while ((fcntl(output->shared_fd, F_SETLKW, &fl) < 0) && (errno == EINTR))
+    {
+	continue;
+    }
+}
+
+/* Attach an output to the shared segment for its template, creating
+ * and initializing the segment if it does not exist.  If the segment
+ * cannot be used the output just does without.
+ */
+void
+shared_attach(LOG_OUTPUT *output)
+{
+    SHARED_STATE	*shared;
+    char		name[64];
+    struct stat		stat_buf;
+    int			created = 1;
+    int			tries;
+    int			fd;
+
+    snprintf(name, sizeof (name), "/cronolog-%08lx",
+	     crc32c(0, output->template, strlen(output->template)));
+    fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, SHARED_MODE);
+    if ((fd < 0) && (errno == EEXIST))
+    {
+	created = 0;
+	fd = shm_open(name, O_RDWR, SHARED_MODE);
+    }
+    if (fd < 0)
+    {
+	perror(name);
+	return;
+    }
+    if (created && (ftruncate(fd, sizeof (SHARED_STATE)) < 0))
+    {
+	perror(name);
+	close(fd);
+	return;
+    }
+
+    /* Another process may have created the segment but not yet set
+     * its size */
+
+    for (tries = 0; ; tries++)
+    {
+	if (fstat(fd, &stat_buf) < 0)
+	{
+	    perror(name);
+	    close(fd);
+	    return;
+	}
+	if (   (stat_buf.st_uid != geteuid())
+	    || (stat_buf.st_mode & (S_IWGRP | S_IWOTH)))
+	{
+	    fprintf(stderr, "%s: shared memory segment belongs to another user"
+		    " or can be written by others, not coordinating\n", name);
+	    close(fd);
+	    return;
+	}
+	if (stat_buf.st_size >= (off_t)sizeof (SHARED_STATE))
+	{
+	    break;
+	}
+	if (tries == 100)
+	{
+	    fprintf(stderr, "%s: shared memory segment was not set up\n", name);
+	    close(fd);
+	    return;
+	}
+	usleep(1000);
+    }
+    shared = mmap(NULL, sizeof (SHARED_STATE), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared == MAP_FAILED)
+    {
+	perror(name);
+	close(fd);
+	return;
+    }
+    output->shared    = shared;
+    output->shared_fd = fd;
+
+    shared_lock(output, F_WRLCK);
+    if (memcmp(shared->magic, SHARED_MAGIC, sizeof (shared->magic)) != 0)
+    {
+	snprintf(shared->template, sizeof (shared->template), "%s", output->template);
+	memcpy(shared->magic, SHARED_MAGIC, sizeof (shared->magic));
+    }
+    shared_lock(output, F_UNLCK);
+
+    if (strcmp(shared->template, output->template) != 0)
+    {
+	DEBUG(("Shared memory segment %s belongs to another template\n", name));
+	munmap(shared, sizeof (SHARED_STATE));
+	close(fd);
+	output->shared    = NULL;
+	output->shared_fd = -1;
+	return;
+    }
+    DEBUG(("Using shared memory segment %s for \"%s\"\n", name, output->template));
+}
+
+/* Compute the boundaries of the period of an output containing a
+ * time, or take them from the shared segment if another process has
+ * already computed them.
+ */
+void
+shared_period(LOG_OUTPUT *output, time_t time_now, time_t *pstart, time_t *pnext)
+{
+    SHARED_STATE	*shared = output->shared;
+    unsigned		seq;
+    time_t		start;
+    time_t		next;
+
+    if (shared)
+    {
+	seq = shared->seq;
+	__sync_synchronize();
+	start = shared->period_start;
+	next  = shared->next_period;
+	if (   !(seq & 1) && (shared->periodicity == output->periodicity)
+	    && (shared->period_multiple == output->period_multiple)
+	    && (start <= time_now) && (time_now < next))
+	{
+	    __sync_synchronize();
+	    if (shared->seq == seq)
+	    {
+		DEBUG(("Period boundaries taken from shared memory\n"));
+		*pstart = start;
+		*pnext  = next;
+		return;
+	    }
+	}
+    }
+
+    *pstart = start_of_this_period(time_now, output->periodicity, output->period_multiple);
+    *pnext  = start_of_next_period(*pstart, output->periodicity, output->period_multiple);
+
+    /* Publish the boundaries.  The sequence count can only be odd
+     * under the lock if the last process to publish died doing so.
+     */
+    if (shared)
+    {
+	shared_lock(output, F_WRLCK);
+	seq = shared->seq;
+	if (seq & 1)
+	{
+	    DEBUG(("Recovering from an interrupted update of the period\n"));
+	    seq++;
+	}
+	shared->seq = seq + 1;
+	__sync_synchronize();
+	shared->periodicity     = output->periodicity;
+	shared->period_multiple = output->period_multiple;
+	shared->period_start    = *pstart;
+	shared->next_period     = *pnext;
+	__sync_synchronize();
+	shared->seq = seq + 2;
+	shared_lock(output, F_UNLCK);
+    }
+}
+
+/* Create the missing directories on the path of the current log file
+ * of an output, unless another process has already created them.
+ */
+void
+shared_create_subdirs(LOG_OUTPUT *output)
+{
+    SHARED_STATE	*shared = output->shared;
+    struct stat		stat_buf;
+    char		dir[MAX_PATH];
+    char		*slash;
+
+    if (shared == NULL)
+    {
+	create_subdirs(output->filename);
+	return;
+    }
+    snprintf(dir, sizeof (dir), "%s", output->filename);
+    if ((slash = strrchr(dir, '/')) != NULL)
+    {
+	*slash = '\0';
+    }
+    shared_lock(output, F_WRLCK);
+    if ((strcmp(shared->dir, dir) != 0) || (stat(dir, &stat_buf) < 0))
+    {
+	create_subdirs(output->filename);
+	snprintf(shared->dir, sizeof (shared->dir), "%s", dir);
+    }
+    else
+    {
+	DEBUG(("Directory \"%s\" was created by another process\n", dir));
+    }
+    shared_lock(output, F_UNLCK);
+}
+
+/* Point the links of an output at its current log file, unless another
+ * process with the same link name has already done so.  The link is
+ * looked for in the segment by name; if it is not there it takes a
+ * free entry, or the entry of the last link when all are in use.
+ */
+void
+shared_create_link(LOG_OUTPUT *output)
+{
+    SHARED_STATE	*shared = output->shared;
+    SHARED_LINK		*link;
+
+    if (shared == NULL)
+    {
+	create_link(output->filename, output->linkname, output->linktype,
+		    output->prevlinkname);
+	return;
+    }
+    shared_lock(output, F_WRLCK);
+    for (link = shared->links; link < shared->links + SHARED_LINKS - 1; link++)
+    {
+	if ((link->name[0] == '\0') || (strcmp(link->name, output->linkname) == 0))
+	{
+	    break;
+	}
+    }
+    if (   (strcmp(link->name, output->linkname) != 0)
+	|| (strcmp(link->target, output->filename) != 0))
+    {
+	create_link(output->filename, output->linkname, output->linktype,
+		    output->prevlinkname);
+	snprintf(link->name, sizeof (link->name), "%s", output->linkname);
+	snprintf(link->target, sizeof (link->target), "%s", output->filename);
+    }
+    else
+    {
+	DEBUG(("Link to \"%s\" was made by another process\n", output->filename));
+    }
+    shared_lock(output, F_UNLCK);
+}
+
+/* Detach an output from its shared segment (the segment itself is
+ * left for the other processes).
+ */
+void
+shared_detach(LOG_OUTPUT *output)
+{
+    if (output->shared == NULL)
+    {
+	return;
+    }
+    munmap(output->shared, sizeof (SHARED_STATE));
+    close(output->shared_fd);
+    output->shared    = NULL;
+    output->shared_fd = -1;
+}
+
+#else /* !HAVE_SHM_OPEN */
+
+void
+shared_attach(LOG_OUTPUT *output)
+{
+    fprintf(stderr, "%s: compiled without support for shared memory\n", output->template);
+}
+
+void
+shared_period(LOG_OUTPUT *output, time_t time_now, time_t *pstart, time_t *pnext)
+{
+    *pstart = start_of_this_period(time_now, output->periodicity, output->period_multiple);
+    *pnext  = start_of_next_period(*pstart, output->periodicity, output->period_multiple);
+}
+
+void
+shared_create_subdirs(LOG_OUTPUT *output)
+{
+    create_subdirs(output->filename);
+}
+
+void
+shared_create_link(LOG_OUTPUT *output)
+{
+    create_link(output->filename, output->linkname, output->linktype,
+		output->prevlinkname);
+}
+
+void
+shared_detach(LOG_OUTPUT *output)
+{
+    (void)output;
+}
+
+#endif
@@ -0,0 +1,378 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronospill -- degraded mode for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * If a fallback directory is given, cronolog does not exit when a log
+ * file cannot be opened or written (typically because the disk is
+ * full or has failed), which would leave the web server without its
+ * log pipe.  Instead it carries on reading its input and holds the
+ * data back: first in a memory pool of SPILL_POOL_SIZE bytes and,
+ * once that is full, in a spill file in the fallback directory named
+ * after the template.  Writing the log file is retried every
+ * SPILL_RETRY seconds; when it succeeds the data held back is written
+ * out in order, followed by the new data.  Data held back is written
+ * to the log file that is current when writing resumes.
+ *
+ * If cronolog exits while degraded the data in memory is saved in the
+ * spill file, and the spill file is written out by the next cronolog
+ * process for the template.  Only if the fallback directory cannot be
+ * written either is data lost, and the amount lost is reported when
+ * writing resumes.
+ */
+
+#include "cronoutils.h"
+
+
+/* Generate the name of the spill file of an output: the template
+ * (with "/" replaced by "_") and the shard number in the fallback
+ * directory.
+ */
+static void
+spill_filename(LOG_OUTPUT *output, char *buf, size_t len)
+{
+    char	*p;
+    int		n;
+
+    n = snprintf(buf, len, "%s/", spill_dir);
+    snprintf(buf + n, len - n, "%s.%d%s", output->template, output->shard, SPILL_SUFFIX);
+    for (p = buf + n; *p; p++)
+    {
+	if (*p == '/')
+	{
+	    *p = '_';
+	}
+    }
+}
+
+/* Write the whole of a buffer to a file descriptor.
+ */
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+    int		n;
+
+    while (len > 0)
+    {
+	if ((n = write(fd, buf, len)) <= 0)
+	{
+	    return -1;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/* Open the spill file of an output if it is not already open.
+ */
+static int
+spill_open(LOG_OUTPUT *output)
+{
+    char	spillname[MAX_PATH];
+
+    if (output->spill_fd >= 0)
+    {
+	return 0;
+    }
+    spill_filename(output, spillname, sizeof (spillname));
+    output->spill_fd = open(spillname, O_RDWR|O_CREAT|O_APPEND, FILE_MODE);
+    if (output->spill_fd < 0)
+    {
+	perror(spillname);
+	return -1;
+    }
+    DEBUG(("Spilling log data to \"%s\"\n", spillname));
+    return 0;
+}
+
+/* Look for data held back by an earlier cronolog process for an
+ * output, which is written out before anything else.
+ */
+void
+spill_init(LOG_OUTPUT *output)
+{
+    char	spillname[MAX_PATH];
+    struct stat	stat_buf;
+
+    if (spill_dir == NULL)
+    {
+	return;
+    }
+    spill_filename(output, spillname, sizeof (spillname));
+    if (   (stat(spillname, &stat_buf) == 0) && (stat_buf.st_size > 0)
+	&& (spill_open(output) == 0))
+    {
+	DEBUG(("Found %ld bytes of log data held back in \"%s\"\n",
+	       (long)stat_buf.st_size, spillname));
+	output->degraded     = 1;
+	output->retry_time   = 0;
+	output->spill_offset = 0;
+    }
+}
+
+/* Hold back a block of data while the log file of an output cannot be
+ * written: in the memory pool while it has room, and otherwise in the
+ * spill file.  Once the spill file is in use everything goes there, to
+ * keep the data in order.
+ */
+void
+spill_write(LOG_OUTPUT *output, const char *data, size_t len)
+{
+    if (output->spill_fd < 0)
+    {
+	if (output->pool == NULL)
+	{
+	    output->pool = malloc(SPILL_POOL_SIZE);
+	}
+	if (output->pool && (output->pool_len + len <= SPILL_POOL_SIZE))
+	{
+	    memcpy(output->pool + output->pool_len, data, len);
+	    output->pool_len += len;
+	    return;
+	}
+	if (spill_open(output) < 0)
+	{
+	    output->dropped += len;
+	    return;
+	}
+    }
+    if (output->pool_len > 0)
+    {
+	if (write_all(output->spill_fd, output->pool, output->pool_len) < 0)
+	{
+	    output->dropped += len;
+	    return;
+	}
+	output->pool_len = 0;
+    }
+    if (write_all(output->spill_fd, data, len) < 0)
+    {
+	output->dropped += len;
+    }
+}
+
+/* Hold back the data of an I/O vector, less its first skip bytes.
+ */
+void
+spill_writev(LOG_OUTPUT *output, const struct iovec *iov, int iovcnt, size_t skip)
+{
+    for (; iovcnt > 0; iov++, iovcnt--)
+    {
+	if (skip >= iov->iov_len)
+	{
+	    skip -= iov->iov_len;
+	    continue;
+	}
+	spill_write(output, (const char *)iov->iov_base + skip, iov->iov_len - skip);
+	skip = 0;
+    }
+}
+
+/* Write the data held back for an output to its log file, which is
+ * open again.  Returns -1 if the log file still cannot be written, in
+ * which case the data not yet written remains held back.
+ */
+int
+spill_resume(LOG_OUTPUT *output)
+{
+    char	spillname[MAX_PATH];
+    char	buf[BUFSIZE];
+    int		n;
+    int		written;
+
+    if (output->spill_fd >= 0)
+    {
+	for (;;)
+	{
+	    if (   (lseek(output->spill_fd, output->spill_offset, SEEK_SET) < 0)
+		|| ((n = read(output->spill_fd, buf, sizeof (buf))) < 0))
+	    {
+		spill_filename(output, spillname, sizeof (spillname));
+		perror(spillname);
+		return -1;
+	    }
+	    if (n == 0)
+	    {
+		break;
+	    }
+	    written = log_writer_write(&output->writer, buf, n);
+	    if (written > 0)
+	    {
+		output->spill_offset += written;
+	    }
+	    if (written != n)
+	    {
+		return -1;
+	    }
+	}
+	spill_filename(output, spillname, sizeof (spillname));
+	close(output->spill_fd);
+	unlink(spillname);
+	output->spill_fd     = -1;
+	output->spill_offset = 0;
+    }
+    if (output->pool_len > 0)
+    {
+	written = log_writer_write(&output->writer, output->pool, output->pool_len);
+	if (written > 0)
+	{
+	    memmove(output->pool, output->pool + written, output->pool_len - written);
+	    output->pool_len -= written;
+	}
+	if (output->pool_len > 0)
+	{
+	    return -1;
+	}
+    }
+    if (output->dropped)
+    {
+	fprintf(stderr, "%s: %ld bytes of log data were lost\n",
+		output->filename, (long)output->dropped);
+	output->dropped = 0;
+    }
+    fprintf(stderr, "%s: writing resumed\n", output->filename);
+    output->degraded = 0;
+    return 0;
+}
+
+/* Remove the part of the spill file of an output that has already been
+ * written out, by copying the rest of it to a new spill file, so that
+ * the next cronolog process does not write it out again.
+ */
+static void
+spill_compact(LOG_OUTPUT *output)
+{
+    char	spillname[MAX_PATH];
+    char	tmpname[MAX_PATH + 8];
+    char	buf[BUFSIZE];
+    int		fd;
+    int		n = 0;
+
+    spill_filename(output, spillname, sizeof (spillname));
+    snprintf(tmpname, sizeof (tmpname), "%s.%d", spillname, (int)getpid());
+    if ((fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, FILE_MODE)) < 0)
+    {
+	perror(tmpname);
+	return;
+    }
+    if (lseek(output->spill_fd, output->spill_offset, SEEK_SET) >= 0)
+    {
+	while (((n = read(output->spill_fd, buf, sizeof (buf))) > 0)
+	       && (write_all(fd, buf, n) == 0))
+	{
+	    continue;
+	}
+    }
+    if ((close(fd) < 0) || (n != 0) || (rename(tmpname, spillname) < 0))
+    {
+	perror(spillname);
+	unlink(tmpname);
+	return;
+    }
+    close(output->spill_fd);
+    output->spill_fd     = -1;
+    output->spill_offset = 0;
+    spill_open(output);
+}
+
+/* Move the data held back in memory for an output to its spill file.
+ */
+void
+spill_save(LOG_OUTPUT *output)
+{
+    if ((output->pool_len > 0) && (spill_open(output) == 0))
+    {
+	if (write_all(output->spill_fd, output->pool, output->pool_len) < 0)
+	{
+	    output->dropped += output->pool_len;
+	}
+	output->pool_len = 0;
+    }
+}
+
+/* Save the data held back in memory for an output in its spill file
+ * when cronolog exits, so that it is written out by the next cronolog
+ * process.
+ */
+void
+spill_close(LOG_OUTPUT *output)
+{
+    if (output->spill_offset > 0)
+    {
+	spill_compact(output);
+    }
+    spill_save(output);
+    if (output->dropped)
+    {
+	fprintf(stderr, "%s: %ld bytes of log data were lost\n",
+		output->template, (long)output->dropped);
+    }
+    if (output->spill_fd >= 0)
+    {
+	close(output->spill_fd);
+	output->spill_fd = -1;
+    }
+}
@@ -0,0 +1,179 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronostamp -- timestamp prefixes for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * Some programs write log lines without a timestamp (CGI scripts
+ * writing to the server's error log, for instance).  If a timestamp
+ * format is given for a template each line written to it is prefixed
+ * with the time at which it was read, formatted with strftime().
+ *
+ * The prefix is formatted at most once a second, from a broken-down
+ * time that is only recomputed with localtime_r() when the minute
+ * changes.  Short lines are copied with their prefixes into a staging
+ * buffer, so that a block of them goes to the writer as one buffer
+ * (passing each prefix and line as buffers of their own costs more
+ * than copying them when the lines are short).  Lines longer
+ * than STAMP_COPY_MAX are not copied but passed to the writer as
+ * buffers of their own, after the staged data and prefix before them.
+ */
+
+#include "cronoutils.h"
+
+
+/* Format the prefix for lines written at a time, unless it is already
+ * cached.
+ */
+static void
+stamp_render(LOG_OUTPUT *output, time_t time_now)
+{
+    struct tm	*tm = &output->stamp_tm;
+    time_t	delta = time_now - output->stamp_time;
+
+    if ((delta == 0) && (output->stamp_time != 0))
+    {
+	return;
+    }
+    if ((output->stamp_time != 0) && (delta > 0) && (tm->tm_sec + delta < 60))
+    {
+	tm->tm_sec += delta;
+    }
+    else
+    {
+#ifndef _WIN32
+	localtime_r(&time_now, tm);
+#else
+	memcpy(tm, localtime(&time_now), sizeof (*tm));
+#endif
+    }
+    output->stamp_time = time_now;
+    output->stamp_len  = strftime(output->stamp, sizeof (output->stamp),
+				  output->stamp_format, tm);
+}
+
+/* Set up an I/O vector for a block of data to be written to an
+ * output, with the timestamp prefix before each line that starts in
+ * the block.  The prefixes and the short lines are copied into the
+ * staging buffer stage (of stage_size bytes, at least STAMP_MAX +
+ * STAMP_COPY_MAX).  At most max_iov (at least 3) buffers are used;
+ * the number of bytes of data they cover is returned in *pused.
+ *
+ * Returns the number of buffers used.
+ */
+int
+stamp_lines(LOG_OUTPUT *output, const char *data, size_t len, time_t time_now,
+	    struct iovec *iov, int max_iov, char *stage, size_t stage_size,
+	    size_t *pused)
+{
+    const char	*p   = data;
+    const char	*end = data + len;
+    const char	*nl;
+    char	*staged = stage;	/* start of the data not yet in the vector */
+    char	*s      = stage;
+    size_t	line_len;
+    int		n = 0;
+
+    stamp_render(output, time_now);
+    while (   (p < end) && (n + 3 <= max_iov)
+	   && ((size_t)(stage + stage_size - s) >= STAMP_MAX + STAMP_COPY_MAX))
+    {
+	if (!output->mid_line)
+	{
+	    memcpy(s, output->stamp, output->stamp_len);
+	    s += output->stamp_len;
+	}
+
+	/* Copy the line if it is short, or pass it on as it is after
+	 * the data staged before it */
+
+	nl = memchr(p, '\n', end - p);
+	line_len = (nl ? nl + 1 : end) - p;
+	if (line_len <= STAMP_COPY_MAX)
+	{
+	    memcpy(s, p, line_len);
+	    s += line_len;
+	}
+	else
+	{
+	    if (s > staged)
+	    {
+		iov[n].iov_base  = staged;
+		iov[n++].iov_len = s - staged;
+		staged = s;
+	    }
+	    iov[n].iov_base  = (char *)p;
+	    iov[n++].iov_len = line_len;
+	}
+	p += line_len;
+	output->mid_line = (nl == NULL);
+    }
+    if (s > staged)
+    {
+	iov[n].iov_base  = staged;
+	iov[n++].iov_len = s - staged;
+    }
+    *pused = p - data;
+    return n;
+}
@@ -0,0 +1,283 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronotrace -- event tracing for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * Debug messages are too slow to leave on in production: each is
+ * formatted with vfprintf() and most format several timestamps.  The
+ * frequent events (reads, writes, rotations, directories created and
+ * links made) are therefore also traced as fixed-size binary records
+ * in a ring of the last TRACE_RECORDS events.  Recording an event
+ * takes a gettimeofday() call and a copy of the record.
+ *
+ * The ring is written to the trace file when the program receives
+ * SIGUSR1, when it is killed by a fatal signal (SIGSEGV, SIGBUS,
+ * SIGILL, SIGFPE or SIGABRT) and when it exits.  The dump is written
+ * with only open(), write() and close() so that it can be done from a
+ * signal handler; it is decoded with the cronodump program.
+ *
+ * When debug messages are requested as well the traced events are
+ * also printed to the debug file, in the same form as cronodump.
+ */
+
+#include "cronoutils.h"
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+
+static const char	*trace_path = NULL;
+static unsigned long	trace_count = 0;
+
+static const char	*trace_names[TRACE_EVENTS] =
+{
+    "read", "write", "rotate", "mkdir", "link"
+};
+
+
+/* Write the trace ring to the trace file, oldest record first.
+ */
+static void
+trace_dump(void)
+{
+    TRACE_HEADER	header;
+    unsigned long	n;
+    unsigned long	first;
+    int			fd;
+
+    if ((trace_ring == NULL) || (trace_path == NULL))
+    {
+	return;
+    }
+    if ((fd = open(trace_path, O_WRONLY|O_CREAT|O_TRUNC, FILE_MODE)) < 0)
+    {
+	return;
+    }
+
+    /* Once the ring has wrapped round the oldest record is the one
+     * that will be overwritten next.
+     */
+    n     = (trace_count < TRACE_RECORDS) ? trace_count : TRACE_RECORDS;
+    first = (trace_count - n) % TRACE_RECORDS;
+
+    memset(&header, 0, sizeof (header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof (header.magic));
+    header.record_size = sizeof (TRACE_RECORD);
+    header.n_records   = n;
+    if (   (write(fd, &header, sizeof (header)) == sizeof (header))
+	&& (write(fd, trace_ring + first, (n - first) * sizeof (TRACE_RECORD)) >= 0))
+    {
+	write(fd, trace_ring, first * sizeof (TRACE_RECORD));
+    }
+    close(fd);
+}
+
+#ifndef _WIN32
+/* Dump the trace ring on SIGUSR1, or before dying of a fatal signal.
+ */
+static void
+trace_signal(int sig)
+{
+    trace_dump();
+    if (sig != SIGUSR1)
+    {
+	signal(sig, SIG_DFL);
+	raise(sig);
+    }
+}
+#endif
+
+/* Start tracing into a ring that is dumped to the file path.
+ *
+ * Returns 0 on success, or -1 on error (with errno set).
+ */
+int
+trace_open(const char *path)
+{
+#ifndef _WIN32
+    static int		fatal[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    struct sigaction	sa;
+    int			i;
+#endif
+
+    trace_ring = calloc(TRACE_RECORDS, sizeof (TRACE_RECORD));
+    if (trace_ring == NULL)
+    {
+	return -1;
+    }
+    trace_path = path;
+    atexit(trace_dump);
+#ifndef _WIN32
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = trace_signal;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    for (i = 0; i < (int)(sizeof (fatal) / sizeof (fatal[0])); i++)
+    {
+	sigaction(fatal[i], &sa, NULL);
+    }
+#endif
+    DEBUG(("Tracing the last %d events to \"%s\"\n", TRACE_RECORDS, path));
+    return 0;
+}
+
+/* Record an event in the trace ring, and print it if debug messages
+ * were requested.  Only the last TRACE_NAME - 1 characters of the
+ * name are kept.
+ */
+void
+trace_event(int event, int output, off_t a, off_t b, const char *name)
+{
+    TRACE_RECORD	record;
+    struct timeval	tv;
+    size_t		len = 0;
+    char		buf[MAX_PATH];
+
+    gettimeofday(&tv, NULL);
+    record.sec    = tv.tv_sec;
+    record.usec   = tv.tv_usec;
+    record.event  = event;
+    record.output = output;
+    record.pad    = 0;
+    record.a      = a;
+    record.b      = b;
+    if (name)
+    {
+	len = strlen(name);
+	if (len >= TRACE_NAME)
+	{
+	    name += len - (TRACE_NAME - 1);
+	    len   = TRACE_NAME - 1;
+	}
+	memcpy(record.name, name, len);
+    }
+    record.name[len] = '\0';
+
+    if (trace_ring)
+    {
+	trace_ring[trace_count++ % TRACE_RECORDS] = record;
+    }
+    if (debug_file)
+    {
+	trace_format(&record, buf, sizeof (buf));
+	fprintf(debug_file, "%s\n", buf);
+    }
+}
+
+/* Describe a trace record in a line of text (without a newline).
+ */
+void
+trace_format(const TRACE_RECORD *record, char *buf, size_t buflen)
+{
+    time_t	t = record->sec;
+    struct tm	tm;
+    char	head[80];
+    char	start[32];
+    char	next[32];
+    int		n;
+
+    localtime_r(&t, &tm);
+    n = strftime(head, sizeof (head), "%Y/%m/%d-%H:%M:%S", &tm);
+    n += snprintf(head + n, sizeof (head) - n, ".%06ld %-6s ", record->usec,
+		  ((record->event >= 0) && (record->event < TRACE_EVENTS)
+		   ? trace_names[record->event] : "?"));
+    if (record->output >= 0)
+    {
+	snprintf(head + n, sizeof (head) - n, "[%d] ", record->output);
+    }
+
+    switch (record->event)
+    {
+    case TRACE_READ:
+	snprintf(buf, buflen, "%s%ld bytes (%ld in all)",
+		 head, (long)record->a, (long)record->b);
+	break;
+
+    case TRACE_WRITE:
+	snprintf(buf, buflen, "%s%ld bytes (file now %ld bytes)",
+		 head, (long)record->a, (long)record->b);
+	break;
+
+    case TRACE_ROTATE:
+	t = record->a;
+	localtime_r(&t, &tm);
+	strftime(start, sizeof (start), "%Y/%m/%d-%H:%M:%S", &tm);
+	t = record->b;
+	localtime_r(&t, &tm);
+	strftime(next, sizeof (next), "%Y/%m/%d-%H:%M:%S", &tm);
+	snprintf(buf, buflen, "%s\"%s\" from %s until %s", head, record->name, start, next);
+	break;
+
+    case TRACE_LINK:
+	snprintf(buf, buflen, "%s%s link to \"%s\"", head,
+		 (record->a == S_IFLNK) ? "symbolic" : "hard", record->name);
+	break;
+
+    default:
+	snprintf(buf, buflen, "%s\"%s\"", head, record->name);
+	break;
+    }
+}
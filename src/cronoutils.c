@@ -69,6 +69,10 @@
  *
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1		/* for strptime() */
+#endif
+
 #include "cronoutils.h"
 /*extern char *tzname[2];*/
 
@@ -82,6 +86,24 @@
 FILE	*debug_file = NULL;
 
 
+/* trace_ring is the ring of trace records, if tracing was requested
+ * (see cronotrace.c).
+ */
+TRACE_RECORD *trace_ring = NULL;
+
+
+/* log_file_flags are the flags with which log files are opened.  The
+ * mmap write engine needs the files opened for reading and writing.
+ */
+int	log_file_flags = O_WRONLY|O_CREAT|O_APPEND;
+
+
+/* spill_dir is the directory in which data is held back when a log
+ * file cannot be written (degraded mode is only used if it is set).
+ */
+char	*spill_dir = NULL;
+
+
 /* America and Europe disagree on whether weeks start on Sunday or
  * Monday - weeks_start_on_mondays is set if a %U specifier is encountered.
  */
@@ -115,58 +137,192 @@ int	period_seconds[] =
     60 * 60 * 24 * 36
 };
 
+/* Expand a log file name template for the period described by tm.
+ * The %N and %{shard} specifiers, which strftime does not know about,
+ * are replaced by the sequence number of the file within the period
+ * and the shard number before the rest of the template is expanded by
+ * strftime.
+ */
+void
+expand_template(const char *template, int sequence, int shard, struct tm *tm,
+		char *pfilename, size_t pfilename_len)
+{
+    char	format[MAX_PATH];
+    char	*q = format;
+    const char	*p;
+
+    for (p = template; *p && (q < format + sizeof (format) - 12); p++)
+    {
+	if ((p[0] == '%') && (p[1] == 'N'))
+	{
+	    q += sprintf(q, "%d", sequence);
+	    p++;
+	}
+	else if (strncmp(p, "%{shard}", 8) == 0)
+	{
+	    q += sprintf(q, "%d", shard);
+	    p += 7;
+	}
+	else if ((p[0] == '%') && (p[1] == '%'))
+	{
+	    *q++ = *p++;
+	    *q++ = *p;
+	}
+	else
+	{
+	    *q++ = *p;
+	}
+    }
+    *q = '\0';
+    strftime(pfilename, pfilename_len, format, tm);
+}
+
+/* Determine whether a template contains a given specifier (e.g. "N"
+ * for %N).
+ */
+int
+template_has_specifier(const char *template, const char *spec)
+{
+    const char	*p;
+
+    for (p = template; (p = strchr(p, '%')); p += 2)
+    {
+	if (strncmp(p + 1, spec, strlen(spec)) == 0)
+	{
+	    return 1;
+	}
+	if (p[1] == '\0')
+	{
+	    break;
+	}
+    }
+    return 0;
+}
+
+/* Initialize an output to the default settings (used by cronolog and
+ * by cronolog_open(), so that new fields are set up for both).
+ */
+void
+init_output(LOG_OUTPUT *output)
+{
+    memset(output, 0, sizeof (*output));
+    output->periodicity        = UNKNOWN;
+    output->period_delay_units = UNKNOWN;
+    output->period_multiple    = 1;
+    output->writer.fd          = -1;
+    output->n_shards           = 1;
+    output->index_fd           = -1;
+    output->catalog_fd         = -1;
+    output->spill_fd           = -1;
+    output->shared_fd          = -1;
+}
+
+/* Find the sequence number to use at the start of a period.  If the
+ * program has been restarted during the period there may already be
+ * files for it: carry on appending to the last of them unless it has
+ * already reached the size limit.
+ */
+static int
+find_sequence(LOG_OUTPUT *output, struct tm *tm)
+{
+    char	filename[MAX_PATH];
+    struct stat	stat_buf;
+    off_t	last_size = -1;
+    int		sequence;
+
+    for (sequence = 0; ; sequence++)
+    {
+	expand_template(output->template, sequence, output->shard, tm,
+			filename, sizeof (filename));
+	if (stat(filename, &stat_buf) < 0)
+	{
+	    break;
+	}
+	last_size = stat_buf.st_size;
+    }
+    if (sequence == 0)
+    {
+	return 0;
+    }
+    DEBUG(("Found %d existing file(s) for the period, last is %ld bytes\n",
+	   sequence, (long)last_size));
+    return (last_size < output->max_size) ? sequence - 1 : sequence;
+}
+
 /* Open a new log file: determine the start of the current
  * period, generate the log file name from the template,
  * determine the end of the period and open the new log file.
  *
- * Returns the file descriptor of the new log file and also sets the
- * name of the file and the start time of the next period via pointers
- * supplied.
+ * If the period has not changed since the last file was opened and
+ * that file was closed at its size limit then the next file in
+ * sequence is opened; otherwise (the file is reopened after an error,
+ * for instance) the same file is opened again.
+ *
+ * Returns the file descriptor of the new log file (or -1 if it cannot
+ * be opened) and also sets the name of the file, the sequence number
+ * and the start time of the next period in the output structure.
  */
 int
-new_log_file(const char *template, const char *linkname, mode_t linktype, const char *prevlinkname,
-	     PERIODICITY periodicity, int period_multiple, int period_delay,
-	     char *pfilename, size_t pfilename_len,
-	     time_t time_now, time_t *pnext_period)
+new_log_file(LOG_OUTPUT *output, time_t time_now)
 {
     time_t 	start_of_period;
-    struct tm 	*tm;
+    time_t	end_of_period;
+    struct tm 	tm;
     int 	log_fd;
 
-    start_of_period = start_of_this_period(time_now, periodicity, period_multiple);
-    tm = localtime(&start_of_period);
-    strftime(pfilename, BUFSIZE, template, tm);
-    *pnext_period = start_of_next_period(start_of_period, periodicity, period_multiple) + period_delay;
+    shared_period(output, time_now, &start_of_period, &end_of_period);
+#ifndef _WIN32
+    localtime_r(&start_of_period, &tm);
+#else
+    memcpy(&tm, localtime(&start_of_period), sizeof (tm));
+#endif
+
+    if (start_of_period != output->period_start)
+    {
+	output->period_start = start_of_period;
+	output->sequence     = output->max_size ? find_sequence(output, &tm) : 0;
+    }
+    else if (output->size_reached)
+    {
+	output->sequence++;
+    }
+    output->size_reached = 0;
+    expand_template(output->template, output->sequence, output->shard, &tm,
+		    output->filename, sizeof (output->filename));
+    output->next_period = end_of_period + output->period_delay;
+    PROBE2(template__rendered, output->filename, output->sequence);
     
-    DEBUG(("%s (%d): using log file \"%s\" from %s (%d) until %s (%d) (for %d secs)\n",
-	   timestamp(time_now), time_now, pfilename, 
-           timestamp(start_of_period), start_of_period,
-	   timestamp(*pnext_period), *pnext_period,
-	   *pnext_period - time_now));
+    TRACE(TRACE_ROTATE, output->number, start_of_period, output->next_period,
+	  output->filename);
     
-    log_fd = open(pfilename, O_WRONLY|O_CREAT|O_APPEND, FILE_MODE);
+    log_fd = open(output->filename, log_file_flags, FILE_MODE);
     
 #ifndef DONT_CREATE_SUBDIRS
     if ((log_fd < 0) && (errno == ENOENT))
     {
-	create_subdirs(pfilename);
-	log_fd = open(pfilename, O_WRONLY|O_CREAT|O_APPEND, FILE_MODE);
+	shared_create_subdirs(output);
+	log_fd = open(output->filename, log_file_flags, FILE_MODE);
     }
 #endif	    
+    PROBE2(open__done, output->filename, log_fd);
 
     if (log_fd < 0)
     {
-	perror(pfilename);
-	exit(2);
+	/* Forget the period so that the sequence number is looked
+	 * for again when the open is retried.
+	 */
+	perror(output->filename);
+	output->period_start = 0;
+	return -1;
     }
 
-    if (linkname)
+    if (output->linkname)
     {
-	create_link(pfilename, linkname, linktype, prevlinkname);
+	shared_create_link(output);
     }
     return log_fd;
 }
-
+
 /* Try to create missing directories on the path of filename.
  *
  * Note that on a busy server there may theoretically be many cronolog
@@ -188,6 +344,7 @@ create_subdirs(char *filename)
     struct stat stat_buf;
     char	dirname[MAX_PATH];
     char	*p;
+    int		rc;
     
     DEBUG(("Creating missing components of \"%s\"\n", filename));
     for (p = filename; (p = strchr(p, '/')); p++)
@@ -209,24 +366,30 @@ create_subdirs(char *filename)
 #endif
 
 	DEBUG(("Testing directory \"%s\"\n", dirname));
-	if (stat(dirname, &stat_buf) < 0)
+	PROBE1(subdir__stat__start, dirname);
+	rc = stat(dirname, &stat_buf);
+	PROBE2(subdir__stat__done, dirname, rc);
+	if (rc < 0)
 	{
 	    if (errno != ENOENT)
 	    {
 		perror(dirname);
-		exit(2);
+		return;
 	    }
 	    else
 	    {
-		DEBUG(("Directory \"%s\" does not exist -- creating\n", dirname));
-		if ((mkdir(dirname, DIR_MODE) < 0) && (errno != EEXIST))
+		TRACE(TRACE_MKDIR, -1, 0, 0, dirname);
+		PROBE1(subdir__mkdir__start, dirname);
 #ifndef _WIN32
-		{
+		rc = mkdir(dirname, DIR_MODE);
 #else
-                if ((mkdir(dirname) < 0) && (errno != EEXIST))
+		rc = mkdir(dirname);
 #endif
+		PROBE2(subdir__mkdir__done, dirname, rc);
+		if ((rc < 0) && (errno != EEXIST))
+		{
 		    perror(dirname);
-		    exit(2);
+		    return;
 		}
 	    }
 	}
@@ -246,8 +409,12 @@ create_link(char *pfilename,
 	    const char *prevlinkname)
 {
     struct stat		stat_buf;
+#ifndef _WIN32
+    int			rc;
+#endif
     
-    if (stat(prevlinkname, &stat_buf) == 0)
+    PROBE2(link__start, pfilename, linkname);
+    if (prevlinkname && (stat(prevlinkname, &stat_buf) == 0))
     {
 	unlink(prevlinkname);
     }
@@ -261,13 +428,19 @@ create_link(char *pfilename,
 	}
     }
 #ifndef _WIN32
+    TRACE(TRACE_LINK, -1, linktype, 0, pfilename);
     if (linktype == S_IFLNK)
     {
-	symlink(pfilename, linkname);
+	rc = symlink(pfilename, linkname);
     }
     else
     {
-	link(pfilename, linkname);
+	rc = link(pfilename, linkname);
+    }
+    PROBE2(link__done, pfilename, rc);
+    if (rc < 0)
+    {
+	DEBUG(("Could not link \"%s\" to \"%s\": %s\n", linkname, pfilename, strerror(errno)));
     }
 #else
     fprintf(stderr, "Creating link from %s to %s not supported", pfilename, linkname);
@@ -440,6 +613,100 @@ parse_timespec(char *optarg, int *p_period_multiple)
     return periodicity;
 }
 
+/* Check that an explicit rotation period divides evenly into the
+ * next larger unit (so that every period starts at the same place in
+ * it).  Returns 1 if the period is valid, else 0.
+ */
+int
+valid_period(PERIODICITY periodicity, int period_multiple)
+{
+    return !(   (periodicity == INVALID_PERIOD)
+	     || (periodicity == PER_SECOND) && (60 % period_multiple)
+	     || (periodicity == PER_MINUTE) && (60 % period_multiple)
+	     || (periodicity == HOURLY)     && (24 % period_multiple)
+	     || (periodicity == DAILY)      && (period_multiple > 365)
+	     || (periodicity == WEEKLY)     && (period_multiple > 52)
+	     || (periodicity == MONTHLY)    && (12 % period_multiple));
+}
+
+/* Parse a size specification: a number optionally followed by k, M
+ * or G (multiples of 1024).  Returns -1 if the specification is invalid.
+ */
+off_t
+parse_size(const char *spec)
+{
+    off_t	size = 0;
+    const char	*p = spec;
+
+    while (isspace(*p)) { p++; }
+    if (!isdigit(*p))
+    {
+	return -1;
+    }
+    while (isdigit(*p))
+    {
+	size = size * 10 + (*p++ - '0');
+    }
+    switch (*p)
+    {
+    case 'g': case 'G':
+	size *= 1024;
+	/* FALLTHROUGH */
+    case 'm': case 'M':
+	size *= 1024;
+	/* FALLTHROUGH */
+    case 'k': case 'K':
+	size *= 1024;
+	p++;
+	break;
+    }
+    while (isspace(*p)) { p++; }
+    return *p ? -1 : size;
+}
+
+/* Parse an age specification: a number followed by a unit (seconds,
+ * minutes, hours, days, weeks or months), e.g. "90days".  Unlike a
+ * rotation period the number is not limited by the next larger unit.
+ * Returns the age in seconds, or -1 if the specification is invalid.
+ */
+time_t
+parse_age(const char *spec)
+{
+    static const char	*units[] = { "sec", "min", "hour", "day", "week", "mon" };
+    const char	*p = spec;
+    long	count = 0;
+    int		i;
+
+    while (isspace(*p)) { p++; }
+    if (!isdigit(*p))
+    {
+	return -1;
+    }
+    while (isdigit(*p))
+    {
+	count = count * 10 + (*p++ - '0');
+	if (count > 100000)
+	{
+	    return -1;
+	}
+    }
+    while (isspace(*p)) { p++; }
+    for (i = 0; i < (int)(sizeof (units) / sizeof (units[0])); i++)
+    {
+	if (strncasecmp(p, units[i], strlen(units[i])) == 0)
+	{
+	    break;
+	}
+    }
+    if ((count == 0) || (i == (int)(sizeof (units) / sizeof (units[0]))))
+    {
+	return -1;
+    }
+    while (isalpha(*p)) { p++; }
+    while (isspace(*p)) { p++; }
+    return *p ? -1 : (time_t)count * period_seconds[PER_SECOND + i];
+}
+
 /* To determine the time of the start of the next period add just
  * enough to move beyond the start of the next period and then
  * determine the time of the start of that period.
@@ -731,6 +998,76 @@ parse_time(char *time_str, int use_american_date_formats)
   
 
 
+/* Parse the Common Log Format timestamp in a log line, e.g.
+ * "[10/Oct/2000:13:55:36 -0700]", into a time_t.  The calculation is
+ * done directly (rather than with mktime) as it is done for every
+ * line and must be safe to call from several threads.
+ *
+ * Returns 0 if a timestamp was found, otherwise -1.
+ */
+int
+parse_clf_time(const char *line, size_t len, time_t *ptime)
+{
+    static const char	months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char		*p   = memchr(line, '[', len);
+    const char		*end = line + len;
+    const char		*m;
+    long		day, mon, year, hour, min, sec, zone, days;
+    int			sign;
+
+    if ((p == NULL) || (end - p < 27))
+    {
+	return -1;
+    }
+    p++;
+#define DIGITS2(s)	(isdigit((unsigned char)(s)[0]) && isdigit((unsigned char)(s)[1]))
+#define VAL2(s)		(((s)[0] - '0') * 10 + ((s)[1] - '0'))
+    if (   !DIGITS2(p) || (p[2] != '/') || (p[6] != '/')
+	|| !DIGITS2(p + 7) || !DIGITS2(p + 9) || (p[11] != ':')
+	|| !DIGITS2(p + 12) || (p[14] != ':') || !DIGITS2(p + 15) || (p[17] != ':')
+	|| !DIGITS2(p + 18) || (p[20] != ' ')
+	|| ((p[21] != '+') && (p[21] != '-')) || !DIGITS2(p + 22) || !DIGITS2(p + 24))
+    {
+	return -1;
+    }
+    for (m = months; *m; m += 3)
+    {
+	if (strncmp(m, p + 3, 3) == 0)
+	{
+	    break;
+	}
+    }
+    if (!*m)
+    {
+	return -1;
+    }
+    day  = VAL2(p);
+    mon  = (m - months) / 3 + 1;
+    year = VAL2(p + 7) * 100 + VAL2(p + 9);
+    hour = VAL2(p + 12);
+    min  = VAL2(p + 15);
+    sec  = VAL2(p + 18);
+    sign = (p[21] == '-') ? -1 : 1;
+    zone = sign * (VAL2(p + 22) * SECS_PER_HOUR + VAL2(p + 24) * SECS_PER_MIN);
+#undef DIGITS2
+#undef VAL2
+
+    /* Days since the epoch of the civil date (proleptic Gregorian) */
+
+    if (mon <= 2)
+    {
+	year--;
+	mon += 12;
+    }
+    days = 365 * year + year / 4 - year / 100 + year / 400
+	 + (153 * (mon - 3) + 2) / 5 + day - 719469;
+
+    *ptime = days * SECS_PER_DAY + hour * SECS_PER_HOUR + min * SECS_PER_MIN + sec - zone;
+    return 0;
+}
+
+
+
 /* Simple debugging print function.
  */
 void
@@ -105,6 +105,64 @@
 # endif
 #endif
 
+/* struct iovec comes from the library interface, so that the two
+ * headers agree (writev() itself is only used if configure found
+ * <sys/uio.h>) */
+
+#include "cronolog.h"
+
+
+/* The functions and variables that are also linked into libcronolog
+ * are given the prefix "cl_", so that they cannot clash with the names
+ * of the programs using the library, whose interface is only the
+ * cronolog_* functions of cronolog.h.  Names added to the library's
+ * source files must be added here. */
+
+#define crc32c			cl_crc32c
+#define crc32c_combine		cl_crc32c_combine
+#define create_link		cl_create_link
+#define create_subdirs		cl_create_subdirs
+#define debug_file		cl_debug_file
+#define determine_periodicity	cl_determine_periodicity
+#define expand_template		cl_expand_template
+#define init_output		cl_init_output
+#define log_file_flags		cl_log_file_flags
+#define log_writer_close	cl_log_writer_close
+#define log_writer_end_frame	cl_log_writer_end_frame
+#define log_writer_open		cl_log_writer_open
+#define log_writer_write	cl_log_writer_write
+#define log_writer_writev	cl_log_writer_writev
+#define mktime_from_utc		cl_mktime_from_utc
+#define new_log_file		cl_new_log_file
+#define parse_age		cl_parse_age
+#define parse_clf_time		cl_parse_clf_time
+#define parse_size		cl_parse_size
+#define parse_time		cl_parse_time
+#define parse_timespec		cl_parse_timespec
+#define period_seconds		cl_period_seconds
+#define periods			cl_periods
+#define print_debug_msg		cl_print_debug_msg
+#define ring_drained		cl_ring_drained
+#define ring_notify_fd		cl_ring_notify_fd
+#define ring_open		cl_ring_open
+#define ring_read		cl_ring_read
+#define shared_attach		cl_shared_attach
+#define shared_create_link	cl_shared_create_link
+#define shared_create_subdirs	cl_shared_create_subdirs
+#define shared_detach		cl_shared_detach
+#define shared_period		cl_shared_period
+#define spill_dir		cl_spill_dir
+#define start_of_next_period	cl_start_of_next_period
+#define start_of_this_period	cl_start_of_this_period
+#define template_has_specifier	cl_template_has_specifier
+#define timestamp		cl_timestamp
+#define trace_event		cl_trace_event
+#define trace_format		cl_trace_format
+#define trace_open		cl_trace_open
+#define trace_ring		cl_trace_ring
+#define valid_period		cl_valid_period
+#define weeks_start_on_mondays	cl_weeks_start_on_mondays
+
 
 #ifdef _WIN32
 #define mode_t int
@@ -120,6 +178,10 @@
 struct tm *localtime_r(const time_t *, struct tm *);
 #endif
 
+#if !HAVE_STRPTIME
+char *strptime(const char *, const char *, struct tm *);
+#endif
+
 /* Some operating systems don't declare getopt() */
 
 #ifdef NEED_GETOPT_DEFS
@@ -161,27 +223,289 @@ typedef enum
 PERIODICITY;
 
 
+/* State of the write engine for the current log file */
+
+typedef struct
+{
+    int		fd;		/* file descriptor of the log file */
+    int		use_mmap;	/* write through mmap'd windows */
+    char	*window;	/* currently mapped window or NULL */
+    off_t	window_start;	/* file offset of the start of the window */
+    size_t	window_size;	/* size of the mapped window */
+    off_t	length;		/* number of bytes of data in the file */
+    void	*compressor;	/* compression state for gzip frames */
+    off_t	frame_size;	/* uncompressed bytes per frame (0 if not compressed) */
+    off_t	frame_bytes;	/* uncompressed bytes in the current frame */
+    int		frame_open;	/* set if a frame has been started */
+    int		do_checksum;	/* count lines and checksum the data written */
+    off_t	start_length;	/* length of the file when it was opened */
+    long	lines;		/* lines of log data written */
+    unsigned long checksum;	/* CRC-32C of the bytes written to the file */
+}
+LOG_WRITER;
+
+
+/* A trace record: an event in the life of the program, kept in an
+ * in-memory ring that can be dumped to a file (see cronotrace.c).
+ * The name is the end of a file name, if the event has one.
+ */
+
+typedef enum
+{
+    TRACE_READ,			/* a = bytes read, b = total input */
+    TRACE_WRITE,		/* a = bytes written, b = length of the file */
+    TRACE_ROTATE,		/* a = start of period, b = start of next period */
+    TRACE_MKDIR,		/* name = directory created */
+    TRACE_LINK,			/* a = link type, name = file linked to */
+    TRACE_EVENTS
+}
+TRACE_EVENT;
+
+typedef struct
+{
+    long	sec;		/* time of the event */
+    long	usec;
+    short	event;
+    short	output;		/* number of the output (or -1) */
+    int		pad;
+    off_t	a;
+    off_t	b;
+    char	name[TRACE_NAME];
+}
+TRACE_RECORD;
+
+/* A trace dump is a header followed by the records, oldest first */
+
+#define TRACE_MAGIC	"CRONOTR"
+
+typedef struct
+{
+    char	magic[8];
+    int		record_size;	/* sizeof (TRACE_RECORD) */
+    int		n_records;	/* number of records that follow */
+}
+TRACE_HEADER;
+
+
+/* A histogram of durations in nanoseconds (see cronohist.c) */
+
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 2) << (HIST_SUB_BITS - 1))
+
+typedef struct
+{
+    unsigned long	counts[HIST_BUCKETS];
+    unsigned long	total;		/* number of values counted */
+    unsigned long long	min;
+    unsigned long long	max;
+}
+HISTOGRAM;
+
+
+/* Formats of input files (see cronoinput.c) */
+
+typedef enum
+{
+    INPUT_PLAIN,
+    INPUT_GZIP,
+    INPUT_BZIP2,
+    INPUT_ZSTD
+}
+INPUT_TYPE;
+
+
+/* A run of lines of an input file split in parallel that go to the
+ * same log file of every output (see cronorange.c).  A time of -1
+ * means the time of the run before (the lines have no timestamp).
+ */
+
+typedef struct
+{
+    const char	*data;		/* the lines, in the mapped input file */
+    off_t	offset;		/* position of the lines in the file */
+    size_t	len;
+    time_t	time;		/* time of the first line with a timestamp */
+    long	undated;	/* number of lines without a timestamp */
+}
+RANGE_SEGMENT;
+
+
+/* An output: a template with its own links, rotation period and
+ * current log file.
+ */
+
+typedef struct
+{
+    char	*template;		/* log file name template */
+    char	*linkname;		/* link to the current log file */
+    mode_t	linktype;		/* S_IFREG (hard) or S_IFLNK (symbolic) */
+    char	*prevlinkname;		/* link to the previous log file */
+    PERIODICITY	periodicity;		/* rotation period */
+    int		period_multiple;	/* number of periods per rotation */
+    PERIODICITY	period_delay_units;	/* units of the rotation delay */
+    int		period_delay;		/* rotation delay (in seconds once set up) */
+    off_t	max_size;		/* size at which to start a new file (or 0) */
+    int		n_shards;		/* number of files per period */
+    int		shard_key;		/* field to hash to choose a shard (or 0) */
+    int		shard;			/* %{shard} number of this output */
+    char	*shard_buf;		/* lines assigned to this shard */
+    size_t	shard_buf_len;
+    char	*partial;		/* incomplete last line (first shard only) */
+    size_t	partial_len;
+    int		next_shard;		/* next shard for round-robin assignment */
+    int		last_shard;		/* shard of the last line assigned */
+    int		split_line;		/* last line assigned was incomplete */
+    int		index_interval;		/* seconds between index records (or 0) */
+    off_t	index_bytes;		/* bytes between index records (or 0) */
+    int		index_fd;		/* index file of the current log file */
+    time_t	index_time;		/* time of the last index record */
+    off_t	index_offset;		/* offset of the last index record */
+    off_t	frame_size;		/* uncompressed bytes per gzip frame (or 0) */
+    time_t	frame_time;		/* time at which the current frame started */
+    char	*catalog;		/* catalog of closed log files (or NULL) */
+    int		catalog_fd;
+    int		write_sum;		/* keep a checksum sidecar for each log file */
+    unsigned long base_checksum;	/* CRC-32C of data written before opening */
+    int		retain_periods;		/* number of periods of log files to keep */
+    time_t	retain_age;		/* age after which log files are deleted */
+    off_t	retain_bytes;		/* total size of log files to keep */
+    time_t	first_write;		/* time of the first write to the log file */
+    time_t	last_write;		/* time of the last write to the log file */
+    char	filename[MAX_PATH];	/* name of the current log file */
+    int		sequence;		/* %N sequence number within the period */
+    int		size_reached;		/* the log file was closed at its size limit */
+    time_t	period_start;		/* start of the current period */
+    time_t	next_period;		/* start of the next period */
+    LOG_WRITER	writer;			/* current log file */
+    int		degraded;		/* data is being held back */
+    time_t	retry_time;		/* time to retry writing the log file */
+    char	*pool;			/* data held back in memory */
+    size_t	pool_len;
+    int		spill_fd;		/* data held back in the fallback directory */
+    off_t	spill_offset;		/* amount of the spill file written out */
+    off_t	dropped;		/* data lost while degraded */
+    int		journal_slot;		/* number of the output in the journal */
+    off_t	journal_start;		/* input position of the data being written */
+    void	*shared;		/* state shared with other processes (or NULL) */
+    int		shared_fd;
+    char	*stamp_format;		/* strftime() format of line prefixes (or NULL) */
+    int		mid_line;		/* the data written so far ends mid-line */
+    time_t	stamp_time;		/* time of the cached prefix */
+    struct tm	stamp_tm;		/* stamp_time broken down */
+    char	stamp[STAMP_MAX];	/* prefix of lines written at stamp_time */
+    size_t	stamp_len;
+    char	*tag;			/* tag of the data taken by this template (or NULL) */
+    int		number;			/* position of the output (for tracing) */
+}
+LOG_OUTPUT;
+
+
 /* Function prototypes */
 
-int		new_log_file(const char *template, const char *linkname,
-			     mode_t linktype, const char *prevlinkname,
-			     PERIODICITY periodicity, int period_multiple, int period_delay,
-			     char *pfilename, size_t pfilename_len,
-			     time_t time_now, time_t *pnext_period);
+void		init_output(LOG_OUTPUT *output);
+int		new_log_file(LOG_OUTPUT *output, time_t time_now);
+void		expand_template(const char *template, int sequence, int shard,
+				struct tm *tm, char *pfilename, size_t pfilename_len);
+int		template_has_specifier(const char *template, const char *spec);
 void		create_subdirs(char *);
 void		create_link(char *, const char *, mode_t, const char *);
 PERIODICITY	determine_periodicity(char *);
 PERIODICITY 	parse_timespec(char *optarg, int *p_period_multiple);
+int		valid_period(PERIODICITY periodicity, int period_multiple);
+off_t		parse_size(const char *spec);
+time_t		parse_age(const char *spec);
 time_t		start_of_next_period(time_t, PERIODICITY, int);
 time_t		start_of_this_period(time_t, PERIODICITY, int);
 void		print_debug_msg(char *msg, ...);
 time_t		parse_time(char *time_str, int);
+int		parse_clf_time(const char *line, size_t len, time_t *ptime);
 char 		*timestamp(time_t thetime);
+int		log_writer_open(LOG_WRITER *writer, int fd, int use_mmap,
+				off_t frame_size, int checksum);
+int		log_writer_write(LOG_WRITER *writer, const char *buf, size_t len);
+int		log_writer_writev(LOG_WRITER *writer, const struct iovec *iov, int iovcnt);
+int		log_writer_end_frame(LOG_WRITER *writer);
+void		log_writer_close(LOG_WRITER *writer);
+void		index_open(LOG_OUTPUT *output);
+void		index_note(LOG_OUTPUT *output, time_t time_now);
+void		index_record(LOG_OUTPUT *output, time_t time_now, off_t offset);
+void		index_close(LOG_OUTPUT *output);
+int		index_filename(const char *filename, char *pindexname, size_t pindexname_len);
+int		query_logs(LOG_OUTPUT *output, time_t from, time_t to);
+int		catalog_open(LOG_OUTPUT *output);
+void		catalog_record(LOG_OUTPUT *output);
+int		checksum_filename(const char *filename, char *psumname, size_t psumname_len);
+void		checksum_open(LOG_OUTPUT *output);
+void		checksum_record(LOG_OUTPUT *output);
+void		retain_logs(LOG_OUTPUT *output, time_t time_now);
+void		spill_init(LOG_OUTPUT *output);
+void		spill_write(LOG_OUTPUT *output, const char *data, size_t len);
+void		spill_writev(LOG_OUTPUT *output, const struct iovec *iov, int iovcnt, size_t skip);
+int		spill_resume(LOG_OUTPUT *output);
+void		spill_save(LOG_OUTPUT *output);
+void		spill_close(LOG_OUTPUT *output);
+int		journal_open(const char *path, int n_outputs);
+off_t		journal_position(void);
+off_t		journal_get_mark(int output, const char **pfilename, off_t *poffset);
+void		journal_mark(int output, off_t pos, const char *filename, off_t offset);
+void		journal_rewind(void);
+int		journal_next(char *buf, size_t buflen, time_t *ptime, off_t *ppos);
+void		journal_commit(void);
+void		journal_reset(void);
+int		journal_append(const char *buf, size_t len, time_t time_now);
+void		shared_attach(LOG_OUTPUT *output);
+void		shared_period(LOG_OUTPUT *output, time_t time_now, time_t *pstart, time_t *pnext);
+void		shared_create_subdirs(LOG_OUTPUT *output);
+void		shared_create_link(LOG_OUTPUT *output);
+void		shared_detach(LOG_OUTPUT *output);
+int		stamp_lines(LOG_OUTPUT *output, const char *data, size_t len, time_t time_now,
+			    struct iovec *iov, int max_iov, char *stage, size_t stage_size,
+			    size_t *pused);
+int		trace_open(const char *path);
+void		trace_event(int event, int output, off_t a, off_t b, const char *name);
+void		trace_format(const TRACE_RECORD *record, char *buf, size_t buflen);
+unsigned long long hist_now(void);
+void		hist_record(HISTOGRAM *hist, unsigned long long value);
+unsigned long long hist_percentile(const HISTOGRAM *hist, double percent);
+void		hist_reset(HISTOGRAM *hist);
+void		hist_print(FILE *fp, const char *name, const HISTOGRAM *hist);
+int		input_open(char **paths, int n_paths, int merge, off_t skip);
+ssize_t		input_next(const char **pdata);
+int		input_position(off_t *poffset);
+ssize_t		input_merge_next(const char **pline, time_t *ptime);
+int		input_type(const char *data, size_t len);
+void		input_close(void);
+int		range_open(const char *path, off_t skip, LOG_OUTPUT *outputs, int n_outputs,
+			   int n_threads);
+int		range_next(RANGE_SEGMENT *segment);
+ssize_t		range_copy(int fd, const RANGE_SEGMENT *segment);
+void		range_close(void);
+int		checkpoint_open(const char *path, char **inputs, int n_inputs,
+				int *pinput, off_t *poffset, time_t *ptime);
+void		checkpoint_opened(const char *filename, off_t length);
+void		checkpoint_mark(LOG_OUTPUT *outputs, int n_outputs, char **inputs,
+				int input, off_t offset, time_t last_time);
+void		checkpoint_done(void);
+int		ring_open(const char *name);
+ssize_t		ring_read(char *buf, size_t buflen);
+int		ring_notify_fd(void);
+void		ring_drained(void);
+int		listen_open(const char *stream, const char *dgram);
+ssize_t		listen_read(char *buf, size_t buflen, const char **ptag);
+void		listen_close(void);
+int		socket_listen(const char *path, int type);
+int		attach_send(const char *path, int fd, int argc, char **argv);
+int		attach_receive(int conn, int *pfd, char ***pargv);
+void		attach_reply(int conn, int accepted);
+unsigned long	crc32c(unsigned long crc, const char *buf, size_t len);
+unsigned long	crc32c_combine(unsigned long crc1, unsigned long crc2, off_t len2);
 
 
 /* Global variables */
 
 extern FILE	*debug_file;
+extern TRACE_RECORD *trace_ring;
+extern int	log_file_flags;
+extern char	*spill_dir;
 extern char	*periods[];
 extern int	period_seconds[];
 
@@ -195,4 +519,31 @@ extern int	period_seconds[];
 
 #define DEBUG(msg_n_args)	do { if (debug_file) print_debug_msg  msg_n_args; } while (0)
 
+/* TRACE records an event in the trace ring and prints it as a debug
+ * message; the frequent events (reads, writes and rotations) are
+ * traced rather than formatted with DEBUG, so that tracing costs
+ * little more than a copy of the record.
+ */
+
+#define TRACE(event, output, a, b, name)	\
+	do { if (trace_ring || debug_file) trace_event((event), (output), (a), (b), (name)); } while (0)
+
+/* PROBE0, PROBE1 and PROBE2 are static tracepoints (USDT probes) of
+ * the "cronolog" provider for bpftrace, perf or SystemTap.  They
+ * compile to a single nop with a note describing the probe and its
+ * arguments, so they cost nothing unless a tracer is attached.  "__"
+ * in a probe name is shown by the tracers as "-".
+ */
+
+#if HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE0(name)		DTRACE_PROBE(cronolog, name)
+#define PROBE1(name, a)		DTRACE_PROBE1(cronolog, name, a)
+#define PROBE2(name, a, b)	DTRACE_PROBE2(cronolog, name, a, b)
+#else
+#define PROBE0(name)
+#define PROBE1(name, a)
+#define PROBE2(name, a, b)
+#endif
+
 #endif
@@ -0,0 +1,476 @@
+/* ====================================================================
+ * Copyright (c) 1995-1999 The Apache Group.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. All advertising materials mentioning features or use of this
+ *    software must display the following acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * 4. The names "Apache Server" and "Apache Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please contact
+ *    apache@apache.org.
+ *
+ * 5. Products derived from this software may not be called "Apache"
+ *    nor may "Apache" appear in their names without prior written
+ *    permission of the Apache Group.
+ *
+ * 6. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by the Apache Group
+ *    for use in the Apache HTTP server project (http://www.apache.org/)."
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE APACHE GROUP ``AS IS'' AND ANY
+ * EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE APACHE GROUP OR
+ * ITS CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Apache Group and was originally based
+ * on public domain software written at the National Center for
+ * Supercomputing Applications, University of Illinois, Urbana-Champaign.
+ * For more information on the Apache Group and the Apache HTTP server
+ * project, please see <http://www.apache.org/>.
+ *
+ */
+/*
+ * cronowrite -- log file write engines for the cronolog program
+ *
+ * Copyright (c) 1996-1999 by Ford & Mason Ltd
+ *
+ * This software was submitted by Ford & Mason Ltd to the Apache
+ * Software Foundation in December 1999.  Future revisions and
+ * derivatives of this source code must acknowledge Ford & Mason Ltd
+ * as the original contributor of this module.  All other licensing
+ * and usage conditions are those of the Apache Software Foundation.
+ *
+ * Log data is normally written to the current log file with one
+ * write() call per buffer read.  As an alternative the file can be
+ * grown in large windows with posix_fallocate() (or ftruncate()) and
+ * mmap(), and the data copied straight into the mapping; the file is
+ * truncated back to the length actually written when the writer is
+ * closed.  As the blocks of each window are reserved before it is
+ * mapped, a full disk is found when the window cannot be reserved
+ * (rather than by a SIGBUS on a store into the mapping); the rest of
+ * the file is then written with write(), which reports the error.
+ *
+ * The mmap engine assumes that this process is the only writer of
+ * the log file; if several cronolog processes share a template the
+ * default write() engine (which opens files with O_APPEND) must be
+ * used.
+ *
+ * With either engine the data can be compressed as a series of
+ * independent gzip members ("frames").  The concatenation is an
+ * ordinary gzip file, but a reader that knows the offset at which a
+ * frame starts (from the time index) can decompress from there
+ * without reading the rest of the file.  The caller decides when a
+ * frame is finished with log_writer_end_frame().
+ */
+
+#include "cronoutils.h"
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+
+/* Attach a writer to a newly opened log file descriptor.  The writer
+ * keeps track of the length of the file, which starts at the current
+ * end of the file, and if checksum is set, of the number of lines of
+ * log data and the CRC-32C of the bytes written to the file.
+ *
+ * For the mmap engine the file must have been opened for reading and
+ * writing (mappings cannot be write-only) and writing starts at the
+ * current end of the file.
+ */
+int
+log_writer_open(LOG_WRITER *writer, int fd, int use_mmap, off_t frame_size, int checksum)
+{
+    writer->fd           = fd;
+    writer->do_checksum  = checksum;
+    writer->checksum     = 0;
+    writer->lines        = 0;
+    writer->frame_size   = 0;
+    writer->frame_bytes  = 0;
+    writer->frame_open   = 0;
+    writer->use_mmap     = 0;
+    writer->window       = NULL;
+    writer->window_start = 0;
+    writer->window_size  = 0;
+    writer->length       = lseek(fd, 0, SEEK_END);
+
+    if (writer->length < 0)
+    {
+	return -1;
+    }
+    writer->start_length = writer->length;
+#if HAVE_SYS_MMAN_H
+    writer->use_mmap = use_mmap;
+#else
+    (void)use_mmap;
+#endif
+#if HAVE_ZLIB_H
+    if (frame_size && (writer->compressor == NULL))
+    {
+	writer->compressor = calloc(1, sizeof (z_stream));
+	if (   (writer->compressor == NULL)
+	    || (deflateInit2((z_stream *)writer->compressor, Z_DEFAULT_COMPRESSION,
+			     Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK))
+	{
+	    free(writer->compressor);
+	    writer->compressor = NULL;
+	    errno = ENOMEM;
+	    return -1;
+	}
+    }
+    else if (writer->compressor)
+    {
+	/* the last frame of the previous file may not have been
+	 * finished (if it could not be written) */
+	deflateReset((z_stream *)writer->compressor);
+    }
+    writer->frame_size = frame_size;
+#endif
+    return fd;
+}
+
+#if HAVE_SYS_MMAN_H
+/* Unmap the current window (if any) and truncate the file to the
+ * length actually written.
+ */
+static void
+unmap_window(LOG_WRITER *writer)
+{
+    if (writer->window)
+    {
+	munmap(writer->window, writer->window_size);
+	writer->window = NULL;
+    }
+    if (ftruncate(writer->fd, writer->length) < 0)
+    {
+	DEBUG(("Cannot truncate log file to %ld bytes\n", (long)writer->length));
+    }
+}
+
+/* Unmap the current window (if any) and map the next one, extending
+ * the file so that the whole of the window is backed by the file.
+ * Windows start on a page boundary at or before the logical end of
+ * the file.
+ */
+static int
+map_next_window(LOG_WRITER *writer)
+{
+    static long	page_size = 0;
+    char	*window;
+    off_t	start;
+
+    if (page_size == 0)
+    {
+	page_size = sysconf(_SC_PAGESIZE);
+    }
+    if (writer->window)
+    {
+	munmap(writer->window, writer->window_size);
+	writer->window = NULL;
+    }
+
+    start = writer->length - (writer->length % page_size);
+#if HAVE_POSIX_FALLOCATE
+    if ((errno = posix_fallocate(writer->fd, start, MMAP_WINDOW_SIZE)) != 0)
+    {
+	return -1;
+    }
+#else
+    if (ftruncate(writer->fd, start + MMAP_WINDOW_SIZE) < 0)
+    {
+	return -1;
+    }
+#endif
+    window = mmap(NULL, MMAP_WINDOW_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED,
+		  writer->fd, start);
+    if (window == MAP_FAILED)
+    {
+	return -1;
+    }
+
+    DEBUG(("Mapped %d byte window at offset %ld\n", MMAP_WINDOW_SIZE, (long)start));
+    writer->window       = window;
+    writer->window_start = start;
+    writer->window_size  = MMAP_WINDOW_SIZE;
+    return 0;
+}
+#endif
+
+/* Write a buffer of data to the log file with whichever engine is in use.
+ *
+ * Returns the number of bytes written, or -1 on error (with errno set).
+ */
+static int
+raw_write(LOG_WRITER *writer, const char *buf, size_t len)
+{
+    size_t	done = 0;
+    int		n;
+#if HAVE_SYS_MMAN_H
+    size_t	chunk;
+    off_t	window_end;
+
+    if (writer->use_mmap)
+    {
+	while (done < len)
+	{
+	    window_end = writer->window_start + writer->window_size;
+	    if ((writer->window == NULL) || (writer->length >= window_end))
+	    {
+		if (map_next_window(writer) < 0)
+		{
+		    /* Write the rest of the file with write() */
+
+		    DEBUG(("Cannot map the next window (%s), using write()\n",
+			   strerror(errno)));
+		    unmap_window(writer);
+		    if (lseek(writer->fd, writer->length, SEEK_SET) < 0)
+		    {
+			return -1;
+		    }
+		    writer->use_mmap = 0;
+		    break;
+		}
+		window_end = writer->window_start + writer->window_size;
+	    }
+	    chunk = window_end - writer->length;
+	    if (chunk > len - done)
+	    {
+		chunk = len - done;
+	    }
+	    memcpy(writer->window + (writer->length - writer->window_start), buf + done, chunk);
+	    writer->length += chunk;
+	    done           += chunk;
+	}
+	if (writer->do_checksum)
+	{
+	    writer->checksum = crc32c(writer->checksum, buf, done);
+	}
+	if (done == len)
+	{
+	    return len;
+	}
+    }
+#endif
+    n = write(writer->fd, buf + done, len - done);
+    if (n > 0)
+    {
+	writer->length += n;
+	if (writer->do_checksum)
+	{
+	    writer->checksum = crc32c(writer->checksum, buf + done, n);
+	}
+    }
+    return (n < 0) ? (done ? (int)done : -1) : (int)done + n;
+}
+
+#if HAVE_ZLIB_H
+/* Run the compressor over the input set up in the stream, writing out
+ * the compressed data as the output buffer fills.
+ */
+static int
+compress_and_write(LOG_WRITER *writer, int flush)
+{
+    z_stream	*zs = (z_stream *)writer->compressor;
+    char	out[BUFSIZE];
+    int		n;
+    int		rc;
+
+    do
+    {
+	zs->next_out  = (Bytef *)out;
+	zs->avail_out = sizeof (out);
+	rc = deflate(zs, flush);
+	if (rc == Z_STREAM_ERROR)
+	{
+	    errno = EINVAL;
+	    return -1;
+	}
+	n = sizeof (out) - zs->avail_out;
+	if ((n > 0) && (raw_write(writer, out, n) != n))
+	{
+	    return -1;
+	}
+    }
+    while ((zs->avail_out == 0) || ((flush == Z_FINISH) && (rc != Z_STREAM_END)));
+    return 0;
+}
+#endif
+
+/* Write a buffer of log data to the log file, compressing it into the
+ * current frame if frames are in use.
+ *
+ * Returns the number of bytes of log data written, or -1 on error
+ * (with errno set).
+ */
+int
+log_writer_write(LOG_WRITER *writer, const char *buf, size_t len)
+{
+#if HAVE_ZLIB_H
+    z_stream	*zs = (z_stream *)writer->compressor;
+#endif
+    const char	*p;
+    const char	*end;
+
+    if (writer->do_checksum)
+    {
+	for (p = buf, end = buf + len; (p = memchr(p, '\n', end - p)); p++)
+	{
+	    writer->lines++;
+	}
+    }
+#if HAVE_ZLIB_H
+
+    if (writer->frame_size)
+    {
+	zs->next_in  = (Bytef *)buf;
+	zs->avail_in = len;
+	if (compress_and_write(writer, Z_NO_FLUSH) < 0)
+	{
+	    return -1;
+	}
+	writer->frame_open   = 1;
+	writer->frame_bytes += len;
+	return len;
+    }
+#endif
+    return raw_write(writer, buf, len);
+}
+
+/* Write the buffers of an I/O vector to the log file: with a single
+ * writev() call for the write() engine, so that lines and separately
+ * held prefixes need not be copied together, otherwise one buffer at
+ * a time.
+ *
+ * Returns the number of bytes of log data written, or -1 on error
+ * (with errno set).
+ */
+int
+log_writer_writev(LOG_WRITER *writer, const struct iovec *iov, int iovcnt)
+{
+    int		total = 0;
+    int		n;
+    int		i;
+
+#if HAVE_SYS_UIO_H
+    if (!writer->use_mmap && !writer->frame_size)
+    {
+	const char	*p;
+	const char	*end;
+	size_t		len;
+
+	total = writev(writer->fd, iov, iovcnt);
+	if (total <= 0)
+	{
+	    return total;
+	}
+	writer->length += total;
+	for (i = 0, n = total; (i < iovcnt) && (n > 0); n -= len, i++)
+	{
+	    len = ((size_t)n < iov[i].iov_len) ? (size_t)n : iov[i].iov_len;
+	    if (writer->do_checksum)
+	    {
+		for (p = iov[i].iov_base, end = p + len; (p = memchr(p, '\n', end - p)); p++)
+		{
+		    writer->lines++;
+		}
+		writer->checksum = crc32c(writer->checksum, iov[i].iov_base, len);
+	    }
+	}
+	return total;
+    }
+#endif
+    for (i = 0; i < iovcnt; i++)
+    {
+	n = log_writer_write(writer, iov[i].iov_base, iov[i].iov_len);
+	if (n < 0)
+	{
+	    return (total > 0) ? total : -1;
+	}
+	total += n;
+	if ((size_t)n < iov[i].iov_len)
+	{
+	    break;
+	}
+    }
+    return total;
+}
+
+/* Finish the current frame (if any), so that everything written so far
+ * can be decompressed and the next data starts a new frame.
+ */
+int
+log_writer_end_frame(LOG_WRITER *writer)
+{
+#if HAVE_ZLIB_H
+    if (writer->frame_open)
+    {
+	z_stream	*zs = (z_stream *)writer->compressor;
+
+	zs->next_in  = NULL;
+	zs->avail_in = 0;
+	if (compress_and_write(writer, Z_FINISH) < 0)
+	{
+	    return -1;
+	}
+	deflateReset(zs);
+	DEBUG(("Finished frame of %ld bytes\n", (long)writer->frame_bytes));
+	writer->frame_open  = 0;
+	writer->frame_bytes = 0;
+    }
+#endif
+    return 0;
+}
+
+/* Close the log file.  Finish the current frame if frames are in use
+ * and for the mmap engine, unmap the current window and truncate the
+ * file to the length actually written.
+ */
+void
+log_writer_close(LOG_WRITER *writer)
+{
+    if (writer->fd < 0)
+    {
+	return;
+    }
+    if (log_writer_end_frame(writer) < 0)
+    {
+	DEBUG(("Cannot finish the last frame of the log file\n"));
+    }
+#if HAVE_SYS_MMAN_H
+    if (writer->use_mmap)
+    {
+	unmap_window(writer);
+    }
+#endif
+    close(writer->fd);
+    writer->fd = -1;
+}
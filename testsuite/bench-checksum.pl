@@ -0,0 +1,90 @@
+#!/usr/bin/perl -w
+#
+# bench-checksum -- measure the cost of cronolog's --checksum option
+#
+# Usage:
+#
+#	perl bench-checksum.pl [cronolog [megabytes [runs]]]
+#
+# A file of log lines (512MB by default) is written in a temporary
+# directory and given to cronolog as its standard input, which is read
+# as fast as it can be, once without and once with --checksum (which
+# computes the CRC-32C of every byte written and keeps a .sum sidecar).
+# The best of three runs of each is reported as MB/s, with the cost of
+# the checksum as a percentage of the plain throughput.
+#
+# The log files are written to $TMPDIR (default /tmp), so that the
+# throughput measured is that of cronolog rather than of a disk.
+
+use strict;
+use Time::HiRes qw(time);
+
+my $cronolog = shift || "../src/cronolog";
+my $megabytes = shift || 512;
+my $runs = shift || 3;
+my $dir = ($ENV{TMPDIR} || "/tmp") . "/bench-checksum.$$";
+
+-x $cronolog or die "$cronolog: not executable\n";
+mkdir $dir or die "$dir: $!\n";
+
+# Write the input: lines of about 100 bytes, like a common log file
+
+my $line = '192.168.%03d.%03d - - [18/Oct/2026:12:00:00 +0000] ' .
+	   '"GET /index.html HTTP/1.1" 200 %05d' . "\n";
+open(INPUT, ">$dir/input") or die "$dir/input: $!\n";
+my $block = "";
+for (my $i = 0; $i < 10000; $i++)
+{
+    $block .= sprintf($line, $i % 256, $i % 199, $i);
+}
+for (my $written = 0; $written < $megabytes * 1024 * 1024; $written += length($block))
+{
+    print INPUT $block;
+}
+close(INPUT);
+my $size = -s "$dir/input";
+
+# Run cronolog on the input, returning the elapsed time
+
+sub run
+{
+    my (@options) = @_;
+
+    unlink(glob("$dir/out*"));
+    my $start = time();
+    my $pid = fork();
+    if ($pid == 0)
+    {
+	open(STDIN, "<$dir/input") or die "$dir/input: $!\n";
+	exec($cronolog, @options, "$dir/out.log") or die "$cronolog: $!\n";
+    }
+    waitpid($pid, 0);
+    my $elapsed = time() - $start;
+    -s "$dir/out.log" == $size or die "cronolog @options: wrong output size\n";
+    return $elapsed;
+}
+
+sub best
+{
+    my (@options) = @_;
+    my $best;
+
+    for (my $i = 0; $i < $runs; $i++)
+    {
+	my $elapsed = run(@options);
+	$best = $elapsed if (!defined($best) || ($elapsed < $best));
+    }
+    return $best;
+}
+
+my $plain = best();
+my $summed = best("--checksum");
+-f "$dir/out.log.sum" or die "no checksum sidecar written\n";
+
+printf("%d MB of input, best of %d runs\n", $size / (1024 * 1024), $runs);
+printf("plain:       %7.1f MB/s\n", $size / (1024 * 1024) / $plain);
+printf("--checksum:  %7.1f MB/s\n", $size / (1024 * 1024) / $summed);
+printf("cost:        %7.1f%%\n", 100 * ($summed - $plain) / $plain);
+
+unlink(glob("$dir/*"));
+rmdir($dir);
@@ -0,0 +1,98 @@
+#!/usr/bin/perl -w
+#
+# bench-mmap -- compare cronolog's write() and --mmap write engines
+#
+# Usage:
+#
+#	perl bench-mmap.pl [cronolog [records [runs]]]
+#
+# A stream of small records (2 million of 72 bytes by default) is
+# written into a pipe four records per write, as a busy server would,
+# and read by cronolog with the default write() engine and with
+# --mmap.  The CPU time of cronolog (user and system) and the elapsed
+# time of the best of three runs of each are reported, and the log
+# files written by the two engines are checked to be identical.
+#
+# The log files are written to $TMPDIR (default /tmp).
+
+use strict;
+use Time::HiRes qw(time);
+
+my $cronolog = shift || "../src/cronolog";
+my $records = shift || 2000000;
+my $runs = shift || 3;
+my $dir = ($ENV{TMPDIR} || "/tmp") . "/bench-mmap.$$";
+
+-x $cronolog or die "$cronolog: not executable\n";
+mkdir $dir or die "$dir: $!\n";
+
+# Four records of 72 bytes (with the newline) per write
+
+my @writes;
+for (my $i = 0; $i < 1000; $i++)
+{
+    my $write = "";
+    for (my $j = 0; $j < 4; $j++)
+    {
+	$write .= sprintf('10.0.%03d.%03d - - [18/Oct/2026:12:00:00 +0000] ' .
+			  '"GET /log/%06d.htm" 200' . "\n", $i % 256, $j, $i * 4 + $j);
+    }
+    push(@writes, $write);
+}
+
+# Run cronolog on the stream, returning its user and system time and
+# the elapsed time
+
+sub run
+{
+    my ($output, @options) = @_;
+
+    unlink($output);
+    pipe(READER, WRITER) or die "pipe: $!\n";
+    my @before = times();
+    my $start = time();
+    my $pid = fork();
+    if ($pid == 0)
+    {
+	close(WRITER);
+	open(STDIN, "<&READER") or die "stdin: $!\n";
+	exec($cronolog, @options, $output) or die "$cronolog: $!\n";
+    }
+    close(READER);
+    for (my $i = 0; $i < $records / 4; $i++)
+    {
+	syswrite(WRITER, $writes[$i % 1000]) or die "write: $!\n";
+    }
+    close(WRITER);
+    waitpid($pid, 0);
+    my $elapsed = time() - $start;
+    my @after = times();
+    return ($after[2] - $before[2], $after[3] - $before[3], $elapsed);
+}
+
+sub best
+{
+    my ($output, @options) = @_;
+    my @best;
+
+    for (my $i = 0; $i < $runs; $i++)
+    {
+	my @times = run($output, @options);
+	@best = @times if (!@best || ($times[0] + $times[1] < $best[0] + $best[1]));
+    }
+    return @best;
+}
+
+my @write = best("$dir/write.log");
+my @mmap = best("$dir/mmap.log", "--mmap");
+
+system("cmp", "-s", "$dir/write.log", "$dir/mmap.log") == 0
+    or die "the two engines wrote different log files\n";
+
+printf("%d records of 72 bytes, 4 per write, best of %d runs\n", $records, $runs);
+printf("           user    system   elapsed\n");
+printf("write():  %6.2fs  %6.2fs  %6.2fs\n", @write);
+printf("--mmap:   %6.2fs  %6.2fs  %6.2fs\n", @mmap);
+
+unlink(glob("$dir/*"));
+rmdir($dir);